@@ -187,35 +187,19 @@ partial class Program
         allHeader.AppendLine("extern RuntimeState *state;");
         foreach (var cls in allClasses)
             allHeader.AppendLine($"extern Definition *def_{cls.Namespace}_{cls.Name};");
+        var compiledKeys = new HashSet<string>(compiledClasses.Select(c => $"{c.Namespace} {c.Name}"));
         foreach (var cls in allClasses)
-            allHeader.AppendLine($"Definition *get_{cls.Namespace}_{cls.Name}(void);");
-        allHeader.AppendLine();
-        allHeader.AppendLine("static inline Definition *find_definition(const char *namespace_, const char *name)");
-        allHeader.AppendLine("{");
-        allHeader.AppendLine("    if (!state)");
-        allHeader.AppendLine("        return NULL;");
-        allHeader.AppendLine("    for (int i = 0; i < arrlen(state->definitions); i++)");
-        allHeader.AppendLine("    {");
-        allHeader.AppendLine("        Definition *def = state->definitions[i];");
-        allHeader.AppendLine("        if (strcmp(def->namespace_, namespace_) == 0 && strcmp(def->name, name) == 0)");
-        allHeader.AppendLine("            return def;");
-        allHeader.AppendLine("    }");
-        allHeader.AppendLine("    return NULL;");
-        allHeader.AppendLine("}");
-        allHeader.AppendLine();
-        allHeader.AppendLine("static inline Definition *ensure_definition(Definition **cache, const char *namespace_, const char *name)");
-        allHeader.AppendLine("{");
-        allHeader.AppendLine("    if (*cache)");
-        allHeader.AppendLine("        return *cache;");
-        allHeader.AppendLine("    Definition *def = find_definition(namespace_, name);");
-        allHeader.AppendLine("    if (!def)");
-        allHeader.AppendLine("    {");
-        allHeader.AppendLine("        printf(\"Missing definition %s %s\\n\", namespace_, name);");
-        allHeader.AppendLine("        abort();");
-        allHeader.AppendLine("    }");
-        allHeader.AppendLine("    *cache = def;");
-        allHeader.AppendLine("    return def;");
-        allHeader.AppendLine("}");
+            if (!compiledKeys.Contains($"{cls.Namespace} {cls.Name}") && cls.Methods.Count > 0)
+                allHeader.AppendLine($"extern void *imp_{cls.Namespace}_{cls.Name}[];");
+        // bindImports fills every def_ handle when the package loads.
+        foreach (var cls in allClasses)
+        {
+            allHeader.AppendLine();
+            allHeader.AppendLine($"static inline Definition *get_{cls.Namespace}_{cls.Name}(void)");
+            allHeader.AppendLine("{");
+            allHeader.AppendLine($"    return def_{cls.Namespace}_{cls.Name};");
+            allHeader.AppendLine("}");
+        }
         var importedNamespacesByClass = new Dictionary<string, List<string>>();
         foreach (var result in results)
             foreach (var cls in result.Classes)
@@ -226,11 +210,12 @@ partial class Program
         File.WriteAllText(typesHeaderPath, typesHeader);
 
         var moduleOutputs = new List<(string Header, string Source, string SourcePath)>();
+        var stringLiterals = new Dictionary<string, int>(StringComparer.Ordinal);
         foreach (var module in moduleInfos)
         {
             timer.Start();
             (string header, string source) =
-                Transpiler.TranspileModule(module.Result.Classes, compiledInterfaces, allClasses, module.Result.ImportedNamespaces, module.Result.UsingTypes, module.IncludeAllPath);
+                Transpiler.TranspileModule(module.Result.Classes, compiledInterfaces, allClasses, compiledClasses, module.Result.ImportedNamespaces, module.Result.UsingTypes, stringLiterals, module.IncludeAllPath);
             timer.Stop();
             moduleOutputs.Add((header, source, module.SourcePath));
         }
@@ -243,12 +228,18 @@ partial class Program
                 allHeader.AppendLine(module.Header);
             }
         }
+        allHeader.Append(Transpiler.TranspileVirtualCalls(allClasses, compiledInterfaces));
+        if (stringLiterals.Count > 0)
+        {
+            allHeader.AppendLine();
+            allHeader.AppendLine("extern StringLiteral string_literals[];");
+        }
         File.WriteAllText(allHeaderPath, allHeader.ToString());
 
         foreach (var module in moduleOutputs)
             File.WriteAllText(module.SourcePath, module.Source);
 
-        string definitionsSource = Transpiler.TranspileDefinitions(compiledClasses, allClasses, "all.h");
+        string definitionsSource = Transpiler.TranspileDefinitions(compiledClasses, allClasses, compiledInterfaces, stringLiterals, "all.h");
         File.WriteAllText(Path.Combine(objRoot, "definitions.c"), definitionsSource);
 
         void ResolveClassTypeNamespace(ClassType classType)
@@ -25,6 +25,8 @@ public record StaticFieldExpression(ClassType Class, string Field, int Line) : E
 public record InstanceFieldExpression(Expression Instance, string Field, int Line) : Expression(Line);
 public record NumberExpression(string Value, int Line) : Expression(Line);
 public record StringExpression(string Value, int Line) : Expression(Line);
+// $"..." string: literal pieces and the values of its {holes}, in order.
+public record InterpolatedStringExpression(List<Expression> Parts, int Line) : Expression(Line);
 public record BinaryExpression(Expression Left, string Op, Expression Right) : Expression(Left.Line);
 public record UnaryExpression(string Op, Expression Right, int Line) : Expression(Line);
 public record PostfixExpression(Expression Left, string Op, int Line) : Expression(Line);
@@ -73,7 +73,11 @@ public static class Parser
                     List<Field> instanceFields = new();
                     while (!tokens.IsSymbol("}"))
                     {
+                        bool virtual_ = tokens.IsIdentifier("virtual");
+                        bool override_ = !virtual_ && tokens.IsIdentifier("override");
                         bool static_ = tokens.IsIdentifier("static");
+                        if (static_ && (virtual_ || override_))
+                            throw new Exception("Static methods cannot be virtual or override");
                         string typeId = tokens.Identifier(out int typeLine);
                         Type? type = null;
                         if (typeId != "void")
@@ -82,7 +86,11 @@ public static class Parser
                         if (name == "Unbox" || name == "Box")
                             throw new Exception("Cannot use Unbox or Box as a member name");
                         if (tokens.IsSymbol(";"))
+                        {
+                            if (virtual_ || override_)
+                                throw new Exception($"Field {name} cannot be virtual or override on line {nameLine}");
                             (static_ ? staticFields : instanceFields).Add(new Field(name, type ?? throw new Exception("Fields cannot use void type"), nameLine));
+                        }
                         else
                         {
                             var args = new List<Type>();
@@ -122,7 +130,7 @@ public static class Parser
                                 statement = ParseStatement(tokens);
                             localIDs.Pop();
                             locals.Pop();
-                            methods.Add(new Method(name, args, type, statement, nameLine) { i = methods.Count });
+                            methods.Add(new Method(name, args, type, statement, nameLine) { i = methods.Count, Virtual = virtual_, Override = override_ });
                         }
                     }
                     if (instanceFields.Count > 0 || baseType != null)
@@ -553,6 +561,11 @@ public static class Parser
                 tokens.Symbol(")");
                 return expression;
             }
+            else if (op == "$\"")
+            {
+                tokens.Compress();
+                return ParseInterpolatedString(tokens, opLine);
+            }
         tokens.Pop();
         Token token = tokens.Get();
         if (token.type == TokenType.Identifier)
@@ -563,6 +576,26 @@ public static class Parser
             return ForString(token);
         throw new Exception($"Invalid expression {token.value}");
     }
+    static Expression ParseInterpolatedString(TokenSet tokens, int line)
+    {
+        List<Expression> parts = new();
+        while (!tokens.IsSymbol("\""))
+        {
+            if (tokens.IsSymbol("{"))
+            {
+                parts.Add(ParseExpression(tokens));
+                tokens.Symbol("}");
+                continue;
+            }
+            Token token = tokens.Get();
+            if (token.type != TokenType.String)
+                throw new Exception($"Invalid interpolated string on line {token.line}");
+            parts.Add(ForString(token));
+        }
+        if (parts.Count == 0)
+            return ForString(new Token(line, TokenType.String, ""));
+        return new InterpolatedStringExpression(parts, line);
+    }
     static Expression ForString(Token token) => new CallStaticExpression(new ClassType("STD", "String"), "New", [new StringExpression(token.value, token.line)], token.line);
     static Expression ParsePostfix(TokenSet tokens, Expression left)
     {
@@ -2,6 +2,9 @@
 public record Method(string Name, List<Type> Arguments, Type? ReturnType, Statement Body, int Line)
 {
     public int i;
+    // virtual starts a vtable slot, override replaces the inherited one.
+    public bool Virtual;
+    public bool Override;
 };
 public record InterfaceMethod(string Name, List<Type> Arguments, Type? ReturnType, int Line);
 public record Field(string Name, Type Type, int Line);
@@ -38,6 +41,8 @@ public record Class(
             writer.Write(method.ReturnType != null);
             if (method.ReturnType != null)
                 method.ReturnType.BinaryOut(writer, classes);
+            writer.Write(method.Virtual);
+            writer.Write(method.Override);
         }
         foreach (var field in StaticFields)
         {
@@ -77,7 +82,9 @@ public record Class(
             Type? returnType = null;
             if (hasReturnType)
                 returnType = Type.BinaryIn(reader);
-            methods.Add(new Method(methodName, args, returnType, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0) { i = i });
+            bool isVirtual = reader.ReadBoolean();
+            bool isOverride = reader.ReadBoolean();
+            methods.Add(new Method(methodName, args, returnType, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0) { i = i, Virtual = isVirtual, Override = isOverride });
         }
         var staticFields = new List<Field>(staticFieldCount);
         for (int i = 0; i < staticFieldCount; i++)
@@ -347,6 +347,90 @@ partial class Program
                 new ClassType("STD", "String") { Nullable = true },
                 new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
                 0
+            ),
+            new Method(
+                "Build",
+                [new ValueType("parts"), new ValueType("int")],
+                new ClassType("STD", "String"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Hash",
+                [new ClassType("STD", "String")],
+                new ValueType("int"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Slice",
+                [new ClassType("STD", "String"), new ValueType("int"), new ValueType("int")],
+                new ClassType("STD", "String"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Substring",
+                [new ClassType("STD", "String"), new ValueType("int"), new ValueType("int")],
+                new ClassType("STD", "String"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "IndexOf",
+                [new ClassType("STD", "String"), new ClassType("STD", "String")],
+                new ValueType("int"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Split",
+                [new ClassType("STD", "String"), new ClassType("STD", "String")],
+                new ClassType("STD", "List"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Trim",
+                [new ClassType("STD", "String")],
+                new ClassType("STD", "String"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Compact",
+                [new ClassType("STD", "String")],
+                new ClassType("STD", "String"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Contains",
+                [new ClassType("STD", "String"), new ClassType("STD", "String")],
+                new ValueType("bool"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "StartsWith",
+                [new ClassType("STD", "String"), new ClassType("STD", "String")],
+                new ValueType("bool"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "Count",
+                [new ClassType("STD", "String"), new ValueType("char")],
+                new ValueType("int"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
+            ),
+            new Method(
+                "IsValidUtf8",
+                [new ClassType("STD", "String")],
+                new ValueType("bool"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
             )
             ],
             new List<Field>(),
@@ -383,6 +467,37 @@ partial class Program
             new List<Field>()
         );
 
+        Class STD_StringBuilder = new Class(
+            "STD",
+            "StringBuilder",
+            0,
+            [
+                new Method("New", [], new ClassType("STD", "StringBuilder"), new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("WithCapacity", [new ValueType("int")], new ClassType("STD", "StringBuilder"), new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ClassType("STD", "String") { Nullable = true }], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("bool")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("int")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("uint")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("long")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("ulong")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("float")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("double")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("byte")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("sbyte")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("char")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("short")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Append", [new ClassType("STD", "StringBuilder"), new ValueType("ushort")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("AppendLine", [new ClassType("STD", "StringBuilder"), new ClassType("STD", "String") { Nullable = true }], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("AppendLine", [new ClassType("STD", "StringBuilder")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Length", [new ClassType("STD", "StringBuilder")], new ValueType("int"), new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Capacity", [new ClassType("STD", "StringBuilder")], new ValueType("int"), new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("Clear", [new ClassType("STD", "StringBuilder")], null, new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0),
+                new Method("ToString", [new ClassType("STD", "StringBuilder")], new ClassType("STD", "String"), new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0), 0)
+            ],
+            new List<Field>(),
+            new List<Field>()
+        );
+
         Class STD_STD = new Class(
             "STD",
             "STD",
@@ -401,6 +516,13 @@ partial class Program
                 new ValueType("double"),
                 new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
                 0
+            ),
+            new Method(
+                "GcThreads",
+                [new ValueType("int")],
+                new ValueType("int"),
+                new BlockStatement(new List<Statement>(), new Dictionary<int, Type>(), 0),
+                0
             )
             ],
             new List<Field>(),
@@ -859,6 +981,7 @@ partial class Program
             STD_String,
             STD_Any,
             STD_List,
+            STD_StringBuilder,
             STD_STD,
             STD_Math,
             STD_MathF,
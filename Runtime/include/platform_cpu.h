@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Vector instruction sets the running CPU supports and the OS saves across
+// context switches.
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_X86_64 1
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+
+static inline void cpu_id(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+  int out[4];
+  __cpuidex(out, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; i++)
+    regs[i] = (uint32_t)out[i];
+}
+
+static inline uint64_t cpu_xgetbv(uint32_t index) { return _xgetbv(index); }
+
+#else
+static inline void cpu_id(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+  __asm__ __volatile__("cpuid"
+                       : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+                       : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint64_t cpu_xgetbv(uint32_t index) {
+  uint32_t lo, hi;
+  __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+  return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+// Every x86-64 CPU has SSE2.
+static inline bool cpu_has_sse2(void) { return true; }
+
+static inline bool cpu_has_avx2(void) {
+  uint32_t regs[4];
+  cpu_id(0, 0, regs);
+  if (regs[0] < 7)
+    return false;
+  cpu_id(1, 0, regs);
+  // OSXSAVE and AVX, then the OS must have enabled XMM and YMM state.
+  if (!(regs[2] & (1u << 27)) || !(regs[2] & (1u << 28)))
+    return false;
+  if ((cpu_xgetbv(0) & 6) != 6)
+    return false;
+  cpu_id(7, 0, regs);
+  return (regs[1] & (1u << 5)) != 0;
+}
+
+#else
+#define CPU_X86_64 0
+
+static inline bool cpu_has_sse2(void) { return false; }
+
+static inline bool cpu_has_avx2(void) { return false; }
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+
+static inline void *mem_alloc_aligned(size_t size, size_t alignment) {
+  return _aligned_malloc(size, alignment);
+}
+
+static inline void mem_free_aligned(void *ptr) {
+  _aligned_free(ptr);
+}
+
+#else
+
+static inline void *mem_alloc_aligned(size_t size, size_t alignment) {
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, alignment, size) != 0)
+    return NULL;
+  return ptr;
+}
+
+static inline void mem_free_aligned(void *ptr) {
+  free(ptr);
+}
+#endif
@@ -0,0 +1,233 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef struct ThreadHandle {
+  HANDLE Handle;
+} ThreadHandle;
+
+typedef void (*ThreadFunc)(void *arg);
+
+typedef struct ThreadStart {
+  ThreadFunc Func;
+  void *Arg;
+} ThreadStart;
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+  ThreadStart *start = (ThreadStart *)param;
+  ThreadFunc func = start->Func;
+  void *arg = start->Arg;
+  free(start);
+  func(arg);
+  return 0;
+}
+
+static inline bool thread_start(ThreadHandle *thread, ThreadFunc func, void *arg) {
+  ThreadStart *start = (ThreadStart *)malloc(sizeof(ThreadStart));
+  if (!start)
+    return false;
+  start->Func = func;
+  start->Arg = arg;
+  thread->Handle = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+  if (!thread->Handle) {
+    free(start);
+    return false;
+  }
+  return true;
+}
+
+static inline void thread_join(ThreadHandle *thread) {
+  WaitForSingleObject(thread->Handle, INFINITE);
+  CloseHandle(thread->Handle);
+}
+
+static inline void thread_yield(void) { SwitchToThread(); }
+
+// Lock and condition variable pair for sleeping until another thread signals.
+typedef struct ThreadSignal {
+  SRWLOCK Lock;
+  CONDITION_VARIABLE Cond;
+} ThreadSignal;
+
+static inline void thread_signal_init(ThreadSignal *signal) {
+  InitializeSRWLock(&signal->Lock);
+  InitializeConditionVariable(&signal->Cond);
+}
+
+static inline void thread_signal_free(ThreadSignal *signal) { (void)signal; }
+
+static inline void thread_lock(ThreadSignal *signal) { AcquireSRWLockExclusive(&signal->Lock); }
+
+static inline void thread_unlock(ThreadSignal *signal) { ReleaseSRWLockExclusive(&signal->Lock); }
+
+// Called with the lock held; releases it while asleep.
+static inline void thread_wait(ThreadSignal *signal) {
+  SleepConditionVariableSRW(&signal->Cond, &signal->Lock, INFINITE, 0);
+}
+
+static inline void thread_wake_all(ThreadSignal *signal) { WakeAllConditionVariable(&signal->Cond); }
+
+static inline int thread_cpu_count(void) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+}
+
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef struct ThreadHandle {
+  pthread_t Handle;
+} ThreadHandle;
+
+typedef void (*ThreadFunc)(void *arg);
+
+typedef struct ThreadStart {
+  ThreadFunc Func;
+  void *Arg;
+} ThreadStart;
+
+static void *thread_trampoline(void *param) {
+  ThreadStart *start = (ThreadStart *)param;
+  ThreadFunc func = start->Func;
+  void *arg = start->Arg;
+  free(start);
+  func(arg);
+  return NULL;
+}
+
+static inline bool thread_start(ThreadHandle *thread, ThreadFunc func, void *arg) {
+  ThreadStart *start = (ThreadStart *)malloc(sizeof(ThreadStart));
+  if (!start)
+    return false;
+  start->Func = func;
+  start->Arg = arg;
+  if (pthread_create(&thread->Handle, NULL, thread_trampoline, start) != 0) {
+    free(start);
+    return false;
+  }
+  return true;
+}
+
+static inline void thread_join(ThreadHandle *thread) {
+  pthread_join(thread->Handle, NULL);
+}
+
+static inline void thread_yield(void) { sched_yield(); }
+
+// Lock and condition variable pair for sleeping until another thread signals.
+typedef struct ThreadSignal {
+  pthread_mutex_t Lock;
+  pthread_cond_t Cond;
+} ThreadSignal;
+
+static inline void thread_signal_init(ThreadSignal *signal) {
+  pthread_mutex_init(&signal->Lock, NULL);
+  pthread_cond_init(&signal->Cond, NULL);
+}
+
+static inline void thread_signal_free(ThreadSignal *signal) {
+  pthread_cond_destroy(&signal->Cond);
+  pthread_mutex_destroy(&signal->Lock);
+}
+
+static inline void thread_lock(ThreadSignal *signal) { pthread_mutex_lock(&signal->Lock); }
+
+static inline void thread_unlock(ThreadSignal *signal) { pthread_mutex_unlock(&signal->Lock); }
+
+// Called with the lock held; releases it while asleep.
+static inline void thread_wait(ThreadSignal *signal) { pthread_cond_wait(&signal->Cond, &signal->Lock); }
+
+static inline void thread_wake_all(ThreadSignal *signal) { pthread_cond_broadcast(&signal->Cond); }
+
+static inline int thread_cpu_count(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+}
+#endif
+
+// Sequentially consistent atomics on plain fields, for the few places the
+// collector shares memory between threads.
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+
+#define THREAD_LOCAL __declspec(thread)
+
+static inline int64_t atomic_load_i64(volatile int64_t *p) {
+  return _InterlockedOr64((volatile long long *)p, 0);
+}
+
+static inline void atomic_store_i64(volatile int64_t *p, int64_t value) {
+  _InterlockedExchange64((volatile long long *)p, value);
+}
+
+static inline bool atomic_cas_i64(volatile int64_t *p, int64_t expected, int64_t desired) {
+  return _InterlockedCompareExchange64((volatile long long *)p, desired, expected) == expected;
+}
+
+static inline int32_t atomic_add_i32(volatile int32_t *p, int32_t value) {
+  return _InterlockedExchangeAdd((volatile long *)p, value) + value;
+}
+
+static inline int32_t atomic_load_i32(volatile int32_t *p) {
+  return _InterlockedOr((volatile long *)p, 0);
+}
+
+static inline uint64_t atomic_or_u64(volatile uint64_t *p, uint64_t bits) {
+  return (uint64_t)_InterlockedOr64((volatile long long *)p, (long long)bits);
+}
+
+static inline uint64_t atomic_and_u64(volatile uint64_t *p, uint64_t bits) {
+  return (uint64_t)_InterlockedAnd64((volatile long long *)p, (long long)bits);
+}
+
+static inline bool atomic_exchange_bool(volatile bool *p, bool value) {
+  return _InterlockedExchange8((volatile char *)p, (char)value) != 0;
+}
+
+static inline void atomic_fence(void) { MemoryBarrier(); }
+
+#else
+#define THREAD_LOCAL _Thread_local
+
+static inline int64_t atomic_load_i64(volatile int64_t *p) {
+  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_store_i64(volatile int64_t *p, int64_t value) {
+  __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+static inline bool atomic_cas_i64(volatile int64_t *p, int64_t expected, int64_t desired) {
+  return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t atomic_add_i32(volatile int32_t *p, int32_t value) {
+  return __atomic_add_fetch(p, value, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t atomic_load_i32(volatile int32_t *p) {
+  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t atomic_or_u64(volatile uint64_t *p, uint64_t bits) {
+  return __atomic_fetch_or(p, bits, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t atomic_and_u64(volatile uint64_t *p, uint64_t bits) {
+  return __atomic_fetch_and(p, bits, __ATOMIC_SEQ_CST);
+}
+
+static inline bool atomic_exchange_bool(volatile bool *p, bool value) {
+  return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_fence(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#endif
@@ -19,6 +19,7 @@
 #include <setjmp.h>
 #include "platform_dll.h"
 #include "platform_time.h"
+#include "platform_memory.h"
 #include "stb_ds.h"
 #include "types.h"
 
@@ -28,18 +29,76 @@
 #define debugprintf(...) ((void)0)
 #endif
 
-#define runtime_reference_local(state, instance, name)                  \
-    ReferenceLocal name = runtime_new_reference_local(state, instance); \
-    state->locals = &name;
-
 #define value_local(type, id) \
     type l_##id = 0;          \
     (void)l_##id;
 
-#define class_local(type, id)                                       \
-    type l_##id = NULL;                                             \
-    runtime_reference_local(state, (Instance **)&l_##id, l_r_##id); \
-    (void)l_##id;
+// Class locals, class arguments and a class return value live in one
+// fixed-size array of roots per method, pushed as a single GcFrame on entry.
+// Block locals get slots by nesting depth, so sibling blocks share them.
+#define frame_roots(count)                                   \
+    Instance *l_frame_roots[count] = {0};                    \
+    GcFrame l_frame = {state->frames, count, l_frame_roots}; \
+    state->frames = &l_frame
+
+#define frame_root(type, slot) ((type)l_frame_roots[slot])
+
+#define set_frame_root(slot, value) l_frame_roots[slot] = (Instance *)(value)
+
+#define class_local(slot) set_frame_root(slot, NULL)
+
+#define class_arg(id, slot) set_frame_root(slot, p_##id)
+
+#define GC_OLD 0x01
+#define GC_REMEMBERED 0x02
+#define GC_FORWARDED 0x04
+#define GC_PINNED 0x08
+#define GC_LARGE 0x10
+// Static instances outside every heap, such as string literals. They count as
+// marked forever, so the collector neither traces nor frees them.
+#define GC_IMMORTAL 0x20
+
+// StringPart kinds: a String (nil reads as empty) or a value formatted the
+// way MathC.ToString would.
+#define STRING_PART_STRING 0
+#define STRING_PART_BOOL 1
+#define STRING_PART_SIGNED 2
+#define STRING_PART_UNSIGNED 3
+#define STRING_PART_FLOAT 4
+#define STRING_PART_CHAR 5
+// A float, printed shortest at float precision; FLOAT parts are doubles.
+#define STRING_PART_FLOAT32 6
+
+#define gc_write_barrier(holder, value)                                        \
+    do                                                                         \
+    {                                                                          \
+        Instance *l_wb_holder = (Instance *)(holder);                          \
+        Instance *l_wb_value = (Instance *)(value);                            \
+        if (!l_wb_value)                                                       \
+            break;                                                             \
+        if (!(l_wb_value->gc_flags & GC_OLD))                                  \
+        {                                                                      \
+            if ((l_wb_holder->gc_flags & (GC_OLD | GC_REMEMBERED)) == GC_OLD)  \
+                runtime_remember(state, l_wb_holder);                          \
+        }                                                                      \
+        else if (state->gc_marking)                                            \
+            runtime_shade(state, l_wb_value);                                  \
+    } while (0)
+
+#define gc_static_barrier(class, value)                        \
+    do                                                         \
+    {                                                          \
+        Instance *l_wb_value = (Instance *)(value);            \
+        if (!l_wb_value)                                       \
+            break;                                             \
+        if (!(l_wb_value->gc_flags & GC_OLD))                  \
+        {                                                      \
+            if (!get_##class()->statics_remembered)            \
+                runtime_remember_statics(state, get_##class()); \
+        }                                                      \
+        else if (state->gc_marking)                            \
+            runtime_shade(state, l_wb_value);                  \
+    } while (0)
 
 #define static_method(type_cast, class, index) \
     ((type_cast)(get_##class()->methods[(index)].entry))
@@ -47,35 +106,45 @@
 #define static_method_call(type_cast, class, index, ...) \
     (static_method(type_cast, class, index)(__VA_ARGS__))
 
+// Call into another package through the import table its bindImports filled
+// when this package was loaded.
+#define import_call(type_cast, class, index, ...) \
+    (((type_cast)imp_##class[(index)])(__VA_ARGS__))
+
 #define set_local(id, value) l_##id = value
 
-#define use(value) (void)value
+#define set_field(class, holder, index, value)                  \
+    do                                                         \
+    {                                                          \
+        class *l_wb_obj = (class *)(holder);                   \
+        l_wb_obj->f_##index = (value);                         \
+        gc_write_barrier(l_wb_obj, l_wb_obj->f_##index);       \
+    } while (0)
 
-#define class_arg(id) runtime_reference_local(state, (Instance **)&p_##id, p_r_##id)
+#define set_static_field(class, index, value)                          \
+    do                                                                 \
+    {                                                                  \
+        static_data(class)->f_##index = (value);                       \
+        gc_static_barrier(class, static_data(class)->f_##index);       \
+    } while (0)
+
+#define use(value) (void)value
 
 #define static_data(class) \
     ((static_##class *)get_##class()->static_data)
 
-#define gc runtime_gc(state)
+// Safepoint poll. It only calls into the runtime once an allocation has left
+// the collector something to do, so polls stay cheap in tight loops.
+#define gc                     \
+    do                         \
+    {                          \
+        if (state->gc_pending) \
+            runtime_gc(state); \
+    } while (0)
 #define gc_force runtime_gc_force(state)
 
-#define block_enter(id) \
-    gc;                 \
-    ReferenceLocal *l_prev_##id = state->locals;
-
-#define block_exit(id)           \
-    state->locals = l_prev_##id; \
-    gc;
-
-#define class_ret(type)                            \
-    type l_retval = NULL;                          \
-    ReferenceLocal *l_init_preret = state->locals; \
-    runtime_reference_local(state, (Instance **)&l_retval, l_r_retval);
-
 #define value_ret(type) type l_retval = 0;
 
-#define method_start ReferenceLocal *l_init = state->locals
-
 #define do_ret_value(x) \
     do                  \
     {                   \
@@ -83,92 +152,186 @@
         goto _ret;      \
     } while (0)
 
+// A class return value is kept in slot 0, so it stays rooted through the
+// safepoint on the way out.
+#define do_ret_class(x)         \
+    do                          \
+    {                           \
+        set_frame_root(0, (x)); \
+        goto _ret;              \
+    } while (0)
+
 #define do_ret_void goto _ret;
 
-#define method_end          \
-    goto _ret;              \
-    _ret:                   \
-    state->locals = l_init; \
-    gc;
+#define method_end \
+    goto _ret;     \
+    _ret:
 
-#define method_end_class_ret state->locals = l_init_preret
+#define frame_pop state->frames = l_frame.prev
+
+#define frame_keep_ret l_frame.count = 1
 
 #define ret_value return l_retval
 
+#define ret_class(type) return frame_root(type, 0)
+
 #define ret_void return
 
-#define try                                        \
-    do                                             \
-    {                                              \
-        volatile jmp_buf buf;                      \
-        volatile ErrorCatcher error_catcher = {0}; \
-        error_catcher.buf = &buf;                  \
-        error_catcher.prev = state->error_catcher; \
-        state->error_catcher = &error_catcher;     \
-        if (setjmp(buf) == 0)
-
-#define catch                                           \
-    else                                                \
-    {                                                   \
-        Instance *exception = runtime_exception(state); \
-        if (exception)                                  \
-
-#define endcatch                               \
-        else                                       \
-            runtime_throw(state, exception);       \
-    }                                          \
-    state->error_catcher = error_catcher.prev; \
-    }                                          \
-    while (0)                                  \
-        ;
+// Exceptions travel back up as a pending state->exception through ordinary
+// returns, so entering a try costs nothing. Every call checks it on return
+// and leaves through the innermost handler label: a try's catch dispatch or
+// the method's own exit.
+#define checked_call(type, handler, ...)    \
+    ({                                      \
+        type l_call = (__VA_ARGS__);        \
+        if (state->exception)               \
+            goto handler;                   \
+        l_call;                             \
+    })
+
+#define checked_void_call(handler, ...) \
+    ({                                  \
+        __VA_ARGS__;                    \
+        if (state->exception)           \
+            goto handler;               \
+    })
+
+#define do_throw(handler, value)                      \
+    do                                                \
+    {                                                 \
+        runtime_throw(state, (Instance *)(value));    \
+        goto handler;                                 \
+    } while (0)
+
+#define catch_begin(label)                      \
+    label:                                      \
+    if (state->exception)                       \
+    {                                           \
+        Instance *exception = state->exception; \
+        state->exception = NULL;
+
+#define catch_end }
 
 #ifdef FUNCTION_SIG
 EXPORT RuntimeState *runtime_init();
 EXPORT bool runtime_load_package(const char *name, RuntimeState *state);
 EXPORT Instance *runtime_new(RuntimeState *state, const char *namespace_, const char *name);
 EXPORT void runtime_free(RuntimeState *state);
-EXPORT ReferenceLocal runtime_new_reference_local(RuntimeState *state, Instance **instance);
 EXPORT void runtime_gc(RuntimeState *state);
 EXPORT void runtime_gc_force(RuntimeState *state);
 EXPORT void runtime_add_alloc(RuntimeState *state, size_t size);
 EXPORT void runtime_sub_alloc(RuntimeState *state, size_t size);
-EXPORT void runtime_show_instance(RuntimeState *state, Instance *instance);
-EXPORT void *runtime_null_coalesce(void *a, void *b);
+EXPORT void runtime_show_instance(RuntimeState *state, Instance **instance);
 EXPORT void *runtime_unwrap(void *a, int line);
 EXPORT void runtime_throw(RuntimeState *state, Instance *exception);
 EXPORT Instance *runtime_exception(RuntimeState *state);
+EXPORT void runtime_remember(RuntimeState *state, Instance *instance);
+EXPORT void runtime_remember_statics(RuntimeState *state, Definition *definition);
+EXPORT Instance *runtime_new_def(RuntimeState *state, Definition *definition);
+EXPORT Definition *runtime_find_definition(RuntimeState *state, const char *namespace_, const char *name);
+EXPORT void runtime_shade(RuntimeState *state, Instance *instance);
+EXPORT int runtime_gc_threads(RuntimeState *state, int threads);
 #else
 #ifdef FUNCTION_VAR
 RuntimeInitFunc runtime_init;
 RuntimeLoadPackageFunc runtime_load_package;
 RuntimeNewFunc runtime_new;
 RuntimeStateInFunc runtime_free;
-RuntimeLocalFunc runtime_new_reference_local;
 RuntimeStateInFunc runtime_gc;
 RuntimeStateInFunc runtime_gc_force;
 RuntimeAllocFunc runtime_add_alloc;
 RuntimeAllocFunc runtime_sub_alloc;
 RuntimeShowInstanceFunc runtime_show_instance;
-RuntimeNullCoalesceFunc runtime_null_coalesce;
 RuntimeUnwrapFunc runtime_unwrap;
 RuntimeThrowFunc runtime_throw;
 RuntimeExceptionFunc runtime_exception;
+RuntimeRememberFunc runtime_remember;
+RuntimeRememberStaticsFunc runtime_remember_statics;
+RuntimeNewDefFunc runtime_new_def;
+RuntimeFindDefinitionFunc runtime_find_definition;
+RuntimeShadeFunc runtime_shade;
+RuntimeGcThreadsFunc runtime_gc_threads;
 #else
 #ifdef FUNCTION_VAR_EXT
 extern RuntimeInitFunc runtime_init;
 extern RuntimeLoadPackageFunc runtime_load_package;
 extern RuntimeNewFunc runtime_new;
 extern RuntimeStateInFunc runtime_free;
-extern RuntimeLocalFunc runtime_new_reference_local;
 extern RuntimeStateInFunc runtime_gc;
 extern RuntimeStateInFunc runtime_gc_force;
 extern RuntimeAllocFunc runtime_add_alloc;
 extern RuntimeAllocFunc runtime_sub_alloc;
 extern RuntimeShowInstanceFunc runtime_show_instance;
-extern RuntimeNullCoalesceFunc runtime_null_coalesce;
 extern RuntimeUnwrapFunc runtime_unwrap;
 extern RuntimeThrowFunc runtime_throw;
 extern RuntimeExceptionFunc runtime_exception;
+extern RuntimeRememberFunc runtime_remember;
+extern RuntimeRememberStaticsFunc runtime_remember_statics;
+extern RuntimeNewDefFunc runtime_new_def;
+extern RuntimeFindDefinitionFunc runtime_find_definition;
+extern RuntimeShadeFunc runtime_shade;
+extern RuntimeGcThreadsFunc runtime_gc_threads;
+#endif
 #endif
 #endif
+
+#ifndef FUNCTION_SIG
+// Fast paths packages run inline instead of calling through the API table.
+// They work on the shared RuntimeState and only cross into the runtime when
+// something has to happen there.
+static inline void *null_coalesce(void *a, void *b)
+{
+    return a ? a : b;
+}
+
+static inline void *unwrap(void *a, int line)
+{
+    if (a)
+        return a;
+    return runtime_unwrap(a, line);
+}
+
+// Interface call on a class the call site has not seen last time. Classes
+// of packages that do not know the interface inherit their base's table.
+static inline void inline_cache_miss(InlineCache *cache, Definition *definition, Interface *interface_, int slot)
+{
+    for (Definition *owner = definition; owner; owner = owner->base)
+        for (int i = 0; i < owner->itable_count; i++)
+        {
+            if (owner->itables[i].interface_ != interface_)
+                continue;
+            cache->definition = definition;
+            cache->entry = owner->itables[i].methods[slot];
+            return;
+        }
+    printf("%s %s does not implement %s\n", definition->namespace_, definition->name, interface_->name);
+    abort();
+}
+
+// A class test is one range check on the preorder class ids.
+static inline bool is_class(Instance *instance, Definition *target)
+{
+    return instance && (unsigned)(instance->definition->class_id - target->class_id) <= (unsigned)(target->class_last - target->class_id);
+}
+
+static inline bool is_interface(Instance *instance, Interface *target)
+{
+    return instance && (instance->definition->interface_bits[target->id >> 6] >> (target->id & 63) & 1);
+}
+
+// A threshold crossing only raises gc_pending; the next safepoint collects.
+static inline void add_alloc(RuntimeState *state, size_t size)
+{
+    state->allocated_bytes += size;
+    if (state->allocated_bytes > state->gc_threshold)
+        state->gc_pending = true;
+}
+
+static inline void sub_alloc(RuntimeState *state, size_t size)
+{
+    if (state->allocated_bytes < size)
+        state->allocated_bytes = 0;
+    else
+        state->allocated_bytes -= size;
+}
 #endif
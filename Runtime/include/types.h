@@ -3,24 +3,39 @@
 typedef struct APITable APITable;
 typedef struct Method Method;
 typedef struct Definition Definition;
+typedef struct Interface Interface;
+typedef struct InterfaceTable InterfaceTable;
+typedef struct InlineCache InlineCache;
+typedef struct StringLiteral StringLiteral;
+typedef struct StringPart StringPart;
 typedef struct RuntimeState RuntimeState;
 typedef struct Instance Instance;
-typedef struct ReferenceLocal ReferenceLocal;
-typedef struct ErrorCatcher ErrorCatcher;
+typedef struct GcFrame GcFrame;
+typedef struct NurseryChunk NurseryChunk;
+typedef struct HeapPage HeapPage;
+typedef struct DefinitionEntry DefinitionEntry;
+typedef struct GcWorker GcWorker;
+typedef struct GcPool GcPool;
+typedef struct GcPart GcPart;
 
-typedef Instance *(*InitFunc)(void);
 typedef void (*FreeFunc)(Instance *thing);
 typedef void (*ShowRefsFunc)(Instance *instance);
+typedef int (*ShowRefsPartFunc)(Instance *instance, int end, int count);
 typedef void (*ShowStaticRefsFunc)(void);
 typedef void (*GetDefinitionsFunc)(APITable *table);
+typedef const char *(*BindImportsFunc)(void);
 typedef RuntimeState *(*RuntimeInitFunc)(void);
 typedef bool (*RuntimeLoadPackageFunc)(const char *name, RuntimeState *state);
 typedef Instance *(*RuntimeNewFunc)(RuntimeState *state, const char *namespace_, const char *name);
+typedef Instance *(*RuntimeNewDefFunc)(RuntimeState *state, Definition *definition);
+typedef Definition *(*RuntimeFindDefinitionFunc)(RuntimeState *state, const char *namespace_, const char *name);
 typedef void (*RuntimeStateInFunc)(RuntimeState *state);
-typedef ReferenceLocal (*RuntimeLocalFunc)(RuntimeState *state, Instance **instance);
 typedef void (*RuntimeAllocFunc)(RuntimeState *state, size_t size);
-typedef void (*RuntimeShowInstanceFunc)(RuntimeState *state, Instance *instance);
-typedef void *(*RuntimeNullCoalesceFunc)(void *a, void *b);
+typedef void (*RuntimeShowInstanceFunc)(RuntimeState *state, Instance **instance);
+typedef void (*RuntimeRememberFunc)(RuntimeState *state, Instance *instance);
+typedef void (*RuntimeRememberStaticsFunc)(RuntimeState *state, Definition *definition);
+typedef void (*RuntimeShadeFunc)(RuntimeState *state, Instance *instance);
+typedef int (*RuntimeGcThreadsFunc)(RuntimeState *state, int threads);
 typedef void *(*RuntimeUnwrapFunc)(void *a, int line);
 typedef void (*RuntimeThrowFunc)(RuntimeState *state, Instance *exception);
 typedef Instance *(*RuntimeExceptionFunc)(RuntimeState *state);
@@ -34,16 +49,20 @@ typedef struct APITable
     RuntimeLoadPackageFunc runtime_load_package;
     RuntimeNewFunc runtime_new;
     RuntimeStateInFunc runtime_free;
-    RuntimeLocalFunc runtime_new_reference_local;
     RuntimeStateInFunc runtime_gc;
     RuntimeStateInFunc runtime_gc_force;
     RuntimeAllocFunc runtime_add_alloc;
     RuntimeAllocFunc runtime_sub_alloc;
     RuntimeShowInstanceFunc runtime_show_instance;
-    RuntimeNullCoalesceFunc runtime_null_coalesce;
     RuntimeUnwrapFunc runtime_unwrap;
     RuntimeThrowFunc runtime_throw;
     RuntimeExceptionFunc runtime_exception;
+    RuntimeRememberFunc runtime_remember;
+    RuntimeRememberStaticsFunc runtime_remember_statics;
+    RuntimeNewDefFunc runtime_new_def;
+    RuntimeFindDefinitionFunc runtime_find_definition;
+    RuntimeShadeFunc runtime_shade;
+    RuntimeGcThreadsFunc runtime_gc_threads;
 } APITable;
 
 typedef struct Method
@@ -58,41 +77,194 @@ typedef struct Definition
     char *name;
     Method *methods;
     int method_count;
+    Definition *base;
+    // Preorder number in the class hierarchy; the class and its subclasses
+    // hold class_id..class_last. The runtime renumbers on every package load.
+    int class_id;
+    int class_last;
+    // Bit per interface id the class implements, inherited ones included.
+    uint64_t *interface_bits;
+    // Entry points by vtable slot, for classes with virtual methods.
+    void **vtable;
+    // One table per interface the class implements, searched on inline
+    // cache misses.
+    InterfaceTable *itables;
+    int itable_count;
     int instance_size;
     Instance **static_data;
-    InitFunc new;
     FreeFunc free;
     ShowRefsFunc show_refs;
+    // References stored since the last minor collection, for definitions
+    // that card-mark their own stores. Without it a remembered instance is
+    // rescanned whole through show_refs.
+    ShowRefsFunc show_dirty_refs;
+    // Shows at most count of the references below index end, from the top
+    // down, and returns where the next part ends (0 once none are left).
+    // Incremental marking uses it for instances that can hold too many
+    // references to show within one slice.
+    ShowRefsPartFunc show_refs_part;
     ShowStaticRefsFunc show_static_refs;
+    bool statics_remembered;
 } Definition;
 
+typedef struct Interface
+{
+    const char *name;
+    // Bit in Definition.interface_bits, handed out when the package loads.
+    int id;
+} Interface;
+
+typedef struct InterfaceTable
+{
+    Interface *interface_;
+    void **methods;
+} InterfaceTable;
+
+// Class an interface call site last saw and the method it resolved to.
+typedef struct InlineCache
+{
+    Definition *definition;
+    void *entry;
+} InlineCache;
+
 typedef struct RuntimeState
 {
     Definition **definitions;
-    ReferenceLocal *locals;
+    // stb_ds string map from "Namespace Name" to the loaded definition.
+    DefinitionEntry *definition_index;
+    // Innermost root frame of the running methods.
+    GcFrame *frames;
+    // Old instances that live outside the slab pages (large and pinned).
     Instance **instances;
+    // Slab pages sorted by address, and per size class the pages with free slots.
+    HeapPage **heap_pages;
+    HeapPage **heap_available;
+    // Per size class, pages whose dead slots the last full collection left
+    // for allocation or later safepoints to sweep.
+    HeapPage **heap_unswept;
+    int heap_unswept_count;
     DllHandle **dlls;
+    // Packages whose imports are not bound yet, waiting on a package that
+    // loads later.
+    BindImportsFunc *import_binders;
+    // Grey instances of the current full collection.
     Instance **gc_worklist;
-    ErrorCatcher *error_catcher;
+    // Grey instances only part of whose references have been shown.
+    GcPart *gc_parts;
+    // Instances promoted by the running minor collection, still to be scanned.
+    Instance **gc_promoted;
+    // Exception being thrown, until a catch takes it.
     Instance *exception;
     size_t allocated_bytes;
     size_t gc_threshold;
+    // Thread-local allocation buffer: runtime_new bumps alloc_cursor towards
+    // alloc_limit inside the newest chunk of the nursery.
+    char *alloc_cursor;
+    char *alloc_limit;
+    NurseryChunk **nursery;
+    NurseryChunk **nursery_free;
+    NurseryChunk **pinned_chunks;
+    size_t nursery_bytes;
+    // Nursery size that triggers a minor collection. With a pause budget it
+    // follows the measured cost of the last minor collections.
+    size_t nursery_limit;
+    // Old instances and static blocks that may point into the nursery.
+    Instance **remembered;
+    Definition **remembered_statics;
+    uintptr_t *gc_candidates;
+    // Large instances sorted by address, rebuilt for each stack scan.
+    Instance **gc_large;
+    void *stack_base;
+    int gc_mode;
+    // Value a mark bit (or Instance.seen) holds once marked this cycle. It
+    // flips at the start of every full collection, so no reset pass is needed.
+    bool mark_epoch;
+    // Set once the collector has work for the next safepoint, which generated
+    // code polls inline before calling runtime_gc.
+    bool gc_pending;
+    // Interface ids handed out so far.
+    int interface_count;
+    // Set while an incremental full collection is marking; field stores then
+    // shade the old instance they write (Dijkstra barrier).
+    bool gc_marking;
+    // Incremental pause budget in ms, 0 for stop-the-world collections.
+    double gc_pause_budget;
+    double gc_slice_end;
+    // Stop-the-world marking runs on gc_threads workers (the calling thread is
+    // worker 0); gc_idle counts the ones that found no work to steal. The
+    // other workers are threads kept in gc_pool between collections.
+    GcWorker *gc_workers;
+    GcPool *gc_pool;
+    int gc_threads;
+    volatile int32_t gc_idle;
 } RuntimeState;
 
 typedef struct Instance {
     Definition *definition;
     bool seen;
+    uint8_t gc_flags;
     Instance *data;
 } Instance;
 
-typedef struct ReferenceLocal 
+// Layout of an STD String, which packages emit their string literals as. The
+// transpiler fills in length and hash; the text is never inline.
+typedef struct StringLiteral {
+    Definition *definition;
+    bool seen;
+    uint8_t gc_flags;
+    uint8_t flags;
+    uint32_t hash;
+    size_t length;
+    const char *data;
+} StringLiteral;
+
+// One operand of a fused string concatenation. STD String.Build measures
+// every part into length before it writes any of them.
+typedef struct StringPart {
+    int kind;
+    size_t length;
+    union {
+        Instance *string;
+        int64_t i;
+        uint64_t u;
+        double d;
+        // A float part once measured: its text, at most 24 bytes.
+        char text[32];
+    };
+} StringPart;
+
+typedef struct NurseryChunk
+{
+    char *start;
+    char *top;
+    int pinned;
+} NurseryChunk;
+
+typedef struct HeapPage
+{
+    HeapPage *next_available;
+    HeapPage *next_unswept;
+    Instance *free_list;
+    char *objects;
+    uint64_t *used;
+    uint64_t *marks;
+    uint32_t object_size;
+    uint32_t reciprocal;
+    uint32_t capacity;
+    uint32_t live;
+    int size_class;
+    bool available;
+} HeapPage;
+
+typedef struct GcFrame
 {
-    Instance **instance;
-    ReferenceLocal *prev;
-} ReferenceLocal;
+    GcFrame *prev;
+    int count;
+    Instance **roots;
+} GcFrame;
 
-typedef struct ErrorCatcher 
+typedef struct DefinitionEntry
 {
-    jmp_buf *buf;
-    ErrorCatcher *prev;
-} ErrorCatcher;
+    char *key;
+    Definition *value;
+} DefinitionEntry;
@@ -2,32 +2,361 @@
 #define STB_DS_IMPLEMENTATION
 #define FUNCTION_SIG
 #include "runtime.h"
+#include "platform_thread.h"
 #include "stb_ds.h"
+#include <limits.h>
 
-EXPORT Instance *runtime_new(RuntimeState *state, const char *namespace_, const char *name)
+#define NURSERY_CHUNK_SIZE (64 * 1024)
+#define NURSERY_SIZE (4 * 1024 * 1024)
+#define NURSERY_MIN_SIZE (4 * NURSERY_CHUNK_SIZE)
+#define NURSERY_LARGE_OBJECT (4 * 1024)
+#define GC_MIN_THRESHOLD (4 * NURSERY_SIZE)
+#define HEAP_PAGE_SIZE (64 * 1024)
+
+enum
 {
-    for (int i = 0; i < arrlen(state->definitions); i++)
+    GC_MODE_MINOR,
+    GC_MODE_MARK,
+};
+
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static inline int bit_ctz64(uint64_t x)
+{
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+}
+#define bit_popcount64(x) ((int)__popcnt64(x))
+#else
+#define bit_ctz64(x) __builtin_ctzll(x)
+#define bit_popcount64(x) __builtin_popcountll(x)
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <xmmintrin.h>
+#define gc_prefetch(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define gc_prefetch(p) __builtin_prefetch(p)
+#endif
+
+#define GC_PREFETCH_DISTANCE 8
+#define GC_SLICE_CHECK_EVERY 256
+#define GC_DEQUE_SIZE 4096
+#define GC_PARALLEL_MIN_PAGES 64
+#define GC_SWEEP_STEP_PAGES 32
+#define GC_PART_REFS 4096
+
+// Chase-Lev work-stealing deque: the owning worker pushes and pops at bottom,
+// thieves take from top. Pushes that find it full go to the owner's private
+// overflow, which refills the deque once it runs dry.
+typedef struct GcDeque
+{
+    volatile int64_t top;
+    char pad[64 - sizeof(int64_t)];
+    volatile int64_t bottom;
+    Instance *volatile slots[GC_DEQUE_SIZE];
+} GcDeque;
+
+typedef struct GcWorker
+{
+    GcDeque deque;
+    Instance **overflow;
+    RuntimeState *state;
+    int index;
+    bool started;
+    ThreadHandle thread;
+} GcWorker;
+
+// Workers 1..gc_threads-1 are started once and sleep between collections.
+// Each full collection bumps generation; a worker marks once per generation
+// and counts itself in done.
+typedef struct GcPool
+{
+    ThreadSignal signal;
+    int generation;
+    int done;
+    int started;
+    bool stop;
+} GcPool;
+
+typedef struct GcPart
+{
+    Instance *instance;
+    int end;
+} GcPart;
+
+// Worker the current thread marks for; runtime_show_instance pushes to its
+// deque. NULL outside parallel marking.
+static THREAD_LOCAL GcWorker *gc_worker = NULL;
+
+// Nursery slots are at least sizeof(Instance) so an evacuated object can keep
+// its forwarding address in the data slot while its definition stays readable
+// for the chunk walk.
+static inline size_t gc_object_size(Definition *def)
+{
+    size_t size = (size_t)def->instance_size;
+    if (size < sizeof(Instance))
+        size = sizeof(Instance);
+    return (size + 7) & ~(size_t)7;
+}
+
+static NurseryChunk *nursery_chunk_new(void)
+{
+    NurseryChunk *chunk = (NurseryChunk *)malloc(sizeof(NurseryChunk) + NURSERY_CHUNK_SIZE);
+    if (!chunk)
     {
-        Definition *def = state->definitions[i];
-        if (strcmp(def->namespace_, namespace_) == 0 && strcmp(def->name, name) == 0)
+        printf("Out of memory growing the nursery\n");
+        abort();
+    }
+    chunk->start = (char *)(chunk + 1);
+    chunk->top = chunk->start;
+    chunk->pinned = 0;
+    return chunk;
+}
+
+static void nursery_sync(RuntimeState *state)
+{
+    if (arrlen(state->nursery) > 0)
+        arrlast(state->nursery)->top = state->alloc_cursor;
+}
+
+// runtime_new never collects; once the nursery outgrows nursery_limit the next
+// safepoint runs a minor collection instead.
+static void nursery_refill(RuntimeState *state)
+{
+    nursery_sync(state);
+    NurseryChunk *chunk = arrlen(state->nursery_free) > 0 ? arrpop(state->nursery_free) : nursery_chunk_new();
+    memset(chunk->start, 0, NURSERY_CHUNK_SIZE);
+    chunk->top = chunk->start;
+    chunk->pinned = 0;
+    arrput(state->nursery, chunk);
+    state->alloc_cursor = chunk->start;
+    state->alloc_limit = chunk->start + NURSERY_CHUNK_SIZE;
+    state->nursery_bytes += NURSERY_CHUNK_SIZE;
+    if (state->nursery_bytes >= state->nursery_limit)
+        state->gc_pending = true;
+}
+
+// Old space: segregated-fit slab pages, one size class per page. Pages are
+// HEAP_PAGE_SIZE aligned so any interior pointer finds its page header by
+// masking, and each page keeps its own allocation and mark bitmaps.
+static const uint32_t heap_size_classes[] = {
+    16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320,
+    384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048, 2560, 3072,
+    3584, 4096,
+};
+#define HEAP_SIZE_CLASS_COUNT ((int)(sizeof(heap_size_classes) / sizeof(heap_size_classes[0])))
+
+static uint8_t heap_class_of_size[NURSERY_LARGE_OBJECT / 8 + 1];
+
+static void heap_init_size_classes(void)
+{
+    int size_class = 0;
+    for (int i = 0; i <= NURSERY_LARGE_OBJECT / 8; i++)
+    {
+        while (heap_size_classes[size_class] < (uint32_t)i * 8)
+            size_class++;
+        heap_class_of_size[i] = (uint8_t)size_class;
+    }
+}
+
+static inline HeapPage *heap_page_of(const void *ptr)
+{
+    return (HeapPage *)((uintptr_t)ptr & ~(uintptr_t)(HEAP_PAGE_SIZE - 1));
+}
+
+// Offsets are below 2^16 and sizes at most 2^12, so multiplying by the
+// rounded-up reciprocal gives the exact quotient without a divide.
+static inline uint32_t heap_slot(HeapPage *page, const void *ptr)
+{
+    uint32_t offset = (uint32_t)((const char *)ptr - page->objects);
+    return (uint32_t)(((uint64_t)offset * page->reciprocal) >> 32);
+}
+
+static inline bool heap_bit(uint64_t *bitmap, uint32_t slot)
+{
+    return (bitmap[slot >> 6] >> (slot & 63)) & 1;
+}
+
+static inline void heap_set_bit(uint64_t *bitmap, uint32_t slot, bool value)
+{
+    uint64_t bit = (uint64_t)1 << (slot & 63);
+    if (value)
+        bitmap[slot >> 6] |= bit;
+    else
+        bitmap[slot >> 6] &= ~bit;
+}
+
+static void heap_rebuild_free_list(HeapPage *page)
+{
+    page->free_list = NULL;
+    for (uint32_t slot = page->capacity; slot-- > 0;)
+    {
+        if (heap_bit(page->used, slot))
+            continue;
+        Instance **cell = (Instance **)(page->objects + (size_t)slot * page->object_size);
+        *cell = page->free_list;
+        page->free_list = (Instance *)cell;
+    }
+}
+
+static void heap_make_available(RuntimeState *state, HeapPage *page)
+{
+    if (page->available || !page->free_list)
+        return;
+    page->available = true;
+    page->next_available = state->heap_available[page->size_class];
+    state->heap_available[page->size_class] = page;
+}
+
+static HeapPage *heap_page_new(RuntimeState *state, int size_class)
+{
+    char *memory = (char *)mem_alloc_aligned(HEAP_PAGE_SIZE, HEAP_PAGE_SIZE);
+    if (!memory)
+    {
+        printf("Out of memory growing the heap\n");
+        abort();
+    }
+    HeapPage *page = (HeapPage *)memory;
+    uint32_t size = heap_size_classes[size_class];
+    uint32_t words = ((HEAP_PAGE_SIZE - (uint32_t)sizeof(HeapPage)) / size + 63) / 64;
+    uintptr_t objects = (uintptr_t)(memory + sizeof(HeapPage) + 2 * words * sizeof(uint64_t));
+    objects = (objects + 15) & ~(uintptr_t)15;
+    page->next_available = NULL;
+    page->next_unswept = NULL;
+    page->objects = (char *)objects;
+    page->used = (uint64_t *)(memory + sizeof(HeapPage));
+    page->marks = page->used + words;
+    page->object_size = size;
+    page->reciprocal = 0xFFFFFFFFu / size + 1;
+    page->capacity = (uint32_t)((uintptr_t)(memory + HEAP_PAGE_SIZE) - objects) / size;
+    page->live = 0;
+    page->size_class = size_class;
+    page->available = false;
+    memset(page->used, 0, 2 * words * sizeof(uint64_t));
+    heap_rebuild_free_list(page);
+
+    int lo = 0, hi = arrlen(state->heap_pages);
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (state->heap_pages[mid] < page)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    arrins(state->heap_pages, lo, page);
+    return page;
+}
+
+// Mark value for instances entering the old space. Between cycles it is the
+// current epoch, which reads as unmarked once the next cycle flips it. While
+// an incremental cycle marks, promoted instances start white and are queued
+// grey, so whatever they reference still gets traced.
+static inline bool gc_fresh_mark(RuntimeState *state)
+{
+    return state->gc_marking ? !state->mark_epoch : state->mark_epoch;
+}
+
+static HeapPage *heap_sweep_class(RuntimeState *state, int size_class);
+
+static Instance *heap_alloc(RuntimeState *state, size_t size)
+{
+    int size_class = heap_class_of_size[(size + 7) / 8];
+    HeapPage *page = state->heap_available[size_class];
+    if (!page)
+        page = heap_sweep_class(state, size_class);
+    if (!page)
+    {
+        page = heap_page_new(state, size_class);
+        heap_make_available(state, page);
+    }
+    Instance *inst = page->free_list;
+    page->free_list = *(Instance **)inst;
+    uint32_t slot = heap_slot(page, inst);
+    heap_set_bit(page->used, slot, true);
+    heap_set_bit(page->marks, slot, gc_fresh_mark(state));
+    page->live++;
+    if (!page->free_list)
+    {
+        state->heap_available[size_class] = page->next_available;
+        page->next_available = NULL;
+        page->available = false;
+    }
+    return inst;
+}
+
+static HeapPage *heap_find_page(RuntimeState *state, uintptr_t address)
+{
+    HeapPage *page = heap_page_of((void *)address);
+    int lo = 0, hi = arrlen(state->heap_pages);
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (state->heap_pages[mid] == page)
+            return page;
+        if (state->heap_pages[mid] < page)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+static Instance *gc_alloc(RuntimeState *state, Definition *def)
+{
+    size_t size = gc_object_size(def);
+    Instance *inst;
+    if (size > NURSERY_LARGE_OBJECT)
+    {
+        inst = (Instance *)calloc(1, size);
+        if (!inst)
         {
-            Instance *inst = def->new();
-            inst->definition = def;
-            inst->seen = false;
-            arrput(state->instances, inst);
-            runtime_add_alloc(state, (size_t)def->instance_size);
-            return inst;
+            printf("Out of memory allocating a large instance\n");
+            abort();
         }
+        inst->gc_flags = GC_OLD | GC_LARGE;
+        inst->seen = state->mark_epoch;
+        arrput(state->instances, inst);
     }
-    return NULL;
+    else
+    {
+        if ((size_t)(state->alloc_limit - state->alloc_cursor) < size)
+            nursery_refill(state);
+        inst = (Instance *)state->alloc_cursor;
+        state->alloc_cursor += size;
+    }
+    inst->definition = def;
+    runtime_add_alloc(state, (size_t)def->instance_size);
+    return inst;
 }
 
-EXPORT ReferenceLocal runtime_new_reference_local(RuntimeState *state, Instance **instance)
+EXPORT Definition *runtime_find_definition(RuntimeState *state, const char *namespace_, const char *name)
 {
-    ReferenceLocal local = {0};
-    local.instance = instance;
-    local.prev = state->locals;
-    return local;
+    char key[256];
+    int len = snprintf(key, sizeof(key), "%s %s", namespace_, name);
+    if (len < 0 || len >= (int)sizeof(key))
+        return NULL;
+    return shget(state->definition_index, key);
+}
+
+EXPORT Instance *runtime_new_def(RuntimeState *state, Definition *definition)
+{
+    if (!definition)
+        return NULL;
+    return gc_alloc(state, definition);
+}
+
+EXPORT Instance *runtime_new(RuntimeState *state, const char *namespace_, const char *name)
+{
+    return runtime_new_def(state, runtime_find_definition(state, namespace_, name));
 }
 
 EXPORT RuntimeState *runtime_init()
@@ -37,12 +366,59 @@ EXPORT RuntimeState *runtime_init()
         return NULL;
 
     state->definitions = NULL;
-    state->locals = NULL;
+    state->definition_index = NULL;
+    sh_new_strdup(state->definition_index);
+    shdefault(state->definition_index, NULL);
+    state->frames = NULL;
     state->instances = NULL;
+    state->heap_pages = NULL;
+    state->heap_available = NULL;
+    arrsetlen(state->heap_available, HEAP_SIZE_CLASS_COUNT);
+    for (int i = 0; i < HEAP_SIZE_CLASS_COUNT; i++)
+        state->heap_available[i] = NULL;
+    state->heap_unswept = NULL;
+    arrsetlen(state->heap_unswept, HEAP_SIZE_CLASS_COUNT);
+    for (int i = 0; i < HEAP_SIZE_CLASS_COUNT; i++)
+        state->heap_unswept[i] = NULL;
+    state->heap_unswept_count = 0;
+    heap_init_size_classes();
     state->dlls = NULL;
+    state->import_binders = NULL;
+    state->interface_count = 0;
     state->gc_worklist = NULL;
+    state->gc_parts = NULL;
+    state->gc_promoted = NULL;
+    state->exception = NULL;
     state->allocated_bytes = 0;
-    state->gc_threshold = 0;
+    state->gc_threshold = GC_MIN_THRESHOLD;
+    state->alloc_cursor = NULL;
+    state->alloc_limit = NULL;
+    state->nursery = NULL;
+    state->nursery_free = NULL;
+    state->pinned_chunks = NULL;
+    state->nursery_bytes = 0;
+    state->nursery_limit = NURSERY_SIZE;
+    state->remembered = NULL;
+    state->remembered_statics = NULL;
+    state->gc_candidates = NULL;
+    state->gc_large = NULL;
+    state->stack_base = NULL;
+    state->gc_mode = GC_MODE_MARK;
+    state->mark_epoch = false;
+    state->gc_pending = false;
+    state->gc_marking = false;
+    state->gc_pause_budget = 0;
+    state->gc_slice_end = 0;
+    const char *budget = getenv("DIM_GC_PAUSE_MS");
+    if (budget)
+        state->gc_pause_budget = atof(budget);
+    state->gc_workers = NULL;
+    state->gc_pool = NULL;
+    state->gc_threads = 1;
+    state->gc_idle = 0;
+    const char *threads = getenv("DIM_GC_THREADS");
+    if (threads)
+        runtime_gc_threads(state, atoi(threads));
     return state;
 }
 #include <stdio.h>
@@ -157,30 +533,86 @@ static void load_packages_from_folder(const char *folder_path, RuntimeState *sta
 #endif
 }
 
+static void gc_release(RuntimeState *state, Instance *inst);
+static void gc_pool_stop(RuntimeState *state);
+
 EXPORT void runtime_free(RuntimeState *state)
 {
     if (!state)
         return;
 
+    for (int i = 0; i < arrlen(state->definitions); i++)
+        free(state->definitions[i]->interface_bits);
     arrfree(state->definitions);
     state->definitions = NULL;
+    shfree(state->definition_index);
     unsigned long long cleaned = 0;
-    for (int i = 0; i < arrlen(state->instances); i++)
+    nursery_sync(state);
+    for (int i = 0; i < arrlen(state->nursery); i++)
     {
-        Instance *inst = state->instances[i];
-        if (inst)
+        NurseryChunk *chunk = state->nursery[i];
+        for (char *p = chunk->start; p < chunk->top;)
+        {
+            Instance *inst = (Instance *)p;
+            Definition *def = inst->definition;
+            p += gc_object_size(def);
+            if (inst->gc_flags & (GC_FORWARDED | GC_PINNED))
+                continue;
+            runtime_sub_alloc(state, def->instance_size);
+            if (def->free)
+                def->free(inst);
+            cleaned++;
+        }
+    }
+    for (int i = 0; i < arrlen(state->heap_pages); i++)
+    {
+        HeapPage *page = state->heap_pages[i];
+        for (uint32_t slot = 0; slot < page->capacity; slot++)
         {
+            if (!heap_bit(page->used, slot))
+                continue;
+            Instance *inst = (Instance *)(page->objects + (size_t)slot * page->object_size);
             Definition *def = inst->definition;
             runtime_sub_alloc(state, def->instance_size);
             if (def->free)
                 def->free(inst);
             cleaned++;
         }
+        mem_free_aligned(page);
+    }
+    arrfree(state->heap_pages);
+    arrfree(state->heap_available);
+    arrfree(state->heap_unswept);
+    for (int i = 0; i < arrlen(state->instances); i++)
+    {
+        Instance *inst = state->instances[i];
+        if (inst)
+        {
+            gc_release(state, inst);
+            cleaned++;
+        }
     }
     debugprintf("runtime free done %llu instances cleaned\n", cleaned);
     arrfree(state->instances);
     state->instances = NULL;
-    state->locals = NULL;
+    state->frames = NULL;
+    for (int i = 0; i < arrlen(state->nursery); i++)
+        free(state->nursery[i]);
+    for (int i = 0; i < arrlen(state->nursery_free); i++)
+        free(state->nursery_free[i]);
+    for (int i = 0; i < arrlen(state->pinned_chunks); i++)
+        free(state->pinned_chunks[i]);
+    arrfree(state->nursery);
+    arrfree(state->nursery_free);
+    arrfree(state->pinned_chunks);
+    arrfree(state->remembered);
+    arrfree(state->remembered_statics);
+    arrfree(state->gc_candidates);
+    arrfree(state->gc_large);
+    arrfree(state->gc_worklist);
+    arrfree(state->gc_parts);
+    arrfree(state->gc_promoted);
+    gc_pool_stop(state);
     for (int i = 0; i < arrlen(state->dlls); i++)
     {
         DllHandle *dll = state->dlls[i];
@@ -188,10 +620,65 @@ EXPORT void runtime_free(RuntimeState *state)
     }
     arrfree(state->dlls);
     state->dlls = NULL;
+    arrfree(state->import_binders);
+    state->import_binders = NULL;
 
     free(state);
 }
 
+static int number_classes_from(RuntimeState *state, Definition *definition, int next, int words)
+{
+    definition->class_id = next++;
+    free(definition->interface_bits);
+    definition->interface_bits = (uint64_t *)calloc(words, sizeof(uint64_t));
+    if (definition->base)
+        memcpy(definition->interface_bits, definition->base->interface_bits, words * sizeof(uint64_t));
+    for (int i = 0; i < definition->itable_count; i++)
+    {
+        int id = definition->itables[i].interface_->id;
+        definition->interface_bits[id >> 6] |= (uint64_t)1 << (id & 63);
+    }
+    for (int i = 0; i < arrlen(state->definitions); i++)
+        if (state->definitions[i]->base == definition)
+            next = number_classes_from(state, state->definitions[i], next, words);
+    definition->class_last = next - 1;
+    return next;
+}
+
+// Numbers every loaded class in preorder of the hierarchy, so is and as
+// against a class compare against one id range, and rebuilds the interface
+// bitsets for the interfaces known so far.
+static void number_classes(RuntimeState *state)
+{
+    int words = (state->interface_count + 63) / 64;
+    if (words == 0)
+        words = 1;
+    int next = 0;
+    for (int i = 0; i < arrlen(state->definitions); i++)
+        if (!state->definitions[i]->base)
+            next = number_classes_from(state, state->definitions[i], next, words);
+}
+
+// Binds the imports of every waiting package whose providers have all been
+// loaded by now. Returns the first import still missing, or NULL.
+static const char *bind_pending_imports(RuntimeState *state)
+{
+    const char *missing = NULL;
+    for (int i = 0; i < arrlen(state->import_binders);)
+    {
+        const char *unbound = state->import_binders[i]();
+        if (!unbound)
+        {
+            arrdel(state->import_binders, i);
+            continue;
+        }
+        missing = unbound;
+        i++;
+    }
+    number_classes(state);
+    return missing;
+}
+
 EXPORT bool runtime_load_package(const char *name, RuntimeState *state)
 {
     if (!state)
@@ -222,112 +709,1083 @@ EXPORT bool runtime_load_package(const char *name, RuntimeState *state)
     table.runtime_load_package = runtime_load_package;
     table.runtime_new = runtime_new;
     table.runtime_free = runtime_free;
-    table.runtime_new_reference_local = runtime_new_reference_local;
     table.runtime_gc = runtime_gc;
     table.runtime_gc_force = runtime_gc_force;
     table.runtime_add_alloc = runtime_add_alloc;
     table.runtime_sub_alloc = runtime_sub_alloc;
     table.runtime_show_instance = runtime_show_instance;
-    table.runtime_null_coalesce = runtime_null_coalesce;
     table.runtime_unwrap = runtime_unwrap;
     table.runtime_throw = runtime_throw;
     table.runtime_exception = runtime_exception;
+    table.runtime_remember = runtime_remember;
+    table.runtime_remember_statics = runtime_remember_statics;
+    table.runtime_new_def = runtime_new_def;
+    table.runtime_find_definition = runtime_find_definition;
+    table.runtime_shade = runtime_shade;
+    table.runtime_gc_threads = runtime_gc_threads;
     ((GetDefinitionsFunc)getDefinitions)(&table);
 
     for (int i = 0; i < table.count; i++)
     {
-        arrput(state->definitions, &table.defs[i]);
+        Definition *def = &table.defs[i];
+        arrput(state->definitions, def);
+        char key[256];
+        int len = snprintf(key, sizeof(key), "%s %s", def->namespace_, def->name);
+        if (len < 0 || len >= (int)sizeof(key))
+        {
+            printf("Definition name too long: %s %s\n", def->namespace_, def->name);
+            continue;
+        }
+        if (shgeti(state->definition_index, key) < 0)
+            shput(state->definition_index, key, def);
     }
 
     arrput(state->dlls, dll);
+    void *bindImports = dll_sym(dll, "bindImports");
+    if (bindImports)
+        arrput(state->import_binders, (BindImportsFunc)bindImports);
+    bind_pending_imports(state);
+    return true;
+}
+
+// Copies a young instance into the old space, leaving a forwarding address
+// behind so every other slot that still points at it gets the same copy.
+static Instance *gc_evacuate(RuntimeState *state, Instance *inst)
+{
+    if (inst->gc_flags & GC_FORWARDED)
+        return inst->data;
+    size_t size = (size_t)inst->definition->instance_size;
+    Instance *copy = heap_alloc(state, size);
+    memcpy(copy, inst, size);
+    copy->gc_flags = GC_OLD;
+    arrput(state->gc_promoted, copy);
+    inst->gc_flags |= GC_FORWARDED;
+    inst->data = copy;
+    return copy;
+}
+
+// Slab instances keep their mark in the page bitmap; large and pinned
+// instances use the seen flag in their header. Either is marked when it
+// equals state->mark_epoch. Immortal instances always read as marked.
+static inline bool gc_is_marked(RuntimeState *state, Instance *inst)
+{
+    if (inst->gc_flags & (GC_LARGE | GC_PINNED | GC_IMMORTAL))
+        return (inst->gc_flags & GC_IMMORTAL) || inst->seen == state->mark_epoch;
+    HeapPage *page = heap_page_of(inst);
+    return heap_bit(page->marks, heap_slot(page, inst)) == state->mark_epoch;
+}
+
+static inline bool gc_mark(RuntimeState *state, Instance *inst)
+{
+    bool epoch = state->mark_epoch;
+    if (inst->gc_flags & (GC_LARGE | GC_PINNED | GC_IMMORTAL))
+    {
+        if ((inst->gc_flags & GC_IMMORTAL) || inst->seen == epoch)
+            return false;
+        inst->seen = epoch;
+        return true;
+    }
+    HeapPage *page = heap_page_of(inst);
+    uint32_t slot = heap_slot(page, inst);
+    if (heap_bit(page->marks, slot) == epoch)
+        return false;
+    heap_set_bit(page->marks, slot, epoch);
     return true;
 }
 
-EXPORT void runtime_show_instance(RuntimeState *state, Instance *instance)
+// gc_mark for parallel marking: exactly one worker sees the bit flip.
+static inline bool gc_mark_atomic(RuntimeState *state, Instance *inst)
+{
+    bool epoch = state->mark_epoch;
+    if (inst->gc_flags & (GC_LARGE | GC_PINNED | GC_IMMORTAL))
+        return !(inst->gc_flags & GC_IMMORTAL) && inst->seen != epoch && atomic_exchange_bool(&inst->seen, epoch) != epoch;
+    HeapPage *page = heap_page_of(inst);
+    uint32_t slot = heap_slot(page, inst);
+    volatile uint64_t *word = &page->marks[slot >> 6];
+    uint64_t bit = (uint64_t)1 << (slot & 63);
+    if (((*word & bit) != 0) == epoch)
+        return false;
+    uint64_t old = epoch ? atomic_or_u64(word, bit) : atomic_and_u64(word, ~bit);
+    return ((old & bit) != 0) != epoch;
+}
+
+static void gc_deque_push(GcWorker *worker, Instance *inst)
 {
-    if (!instance)
+    GcDeque *deque = &worker->deque;
+    int64_t bottom = deque->bottom;
+    if (bottom - atomic_load_i64(&deque->top) >= GC_DEQUE_SIZE)
+    {
+        arrput(worker->overflow, inst);
         return;
-    if (instance->seen)
+    }
+    deque->slots[bottom & (GC_DEQUE_SIZE - 1)] = inst;
+    atomic_store_i64(&deque->bottom, bottom + 1);
+}
+
+static Instance *gc_deque_pop(GcWorker *worker)
+{
+    GcDeque *deque = &worker->deque;
+    int64_t bottom = deque->bottom - 1;
+    atomic_store_i64(&deque->bottom, bottom);
+    int64_t top = atomic_load_i64(&deque->top);
+    if (top > bottom)
+    {
+        atomic_store_i64(&deque->bottom, bottom + 1);
+        return NULL;
+    }
+    Instance *inst = deque->slots[bottom & (GC_DEQUE_SIZE - 1)];
+    if (top == bottom)
+    {
+        // Last entry: race any thief for it.
+        if (!atomic_cas_i64(&deque->top, top, top + 1))
+            inst = NULL;
+        atomic_store_i64(&deque->bottom, bottom + 1);
+    }
+    return inst;
+}
+
+static Instance *gc_deque_steal(GcWorker *victim)
+{
+    GcDeque *deque = &victim->deque;
+    int64_t top = atomic_load_i64(&deque->top);
+    int64_t bottom = atomic_load_i64(&deque->bottom);
+    if (top >= bottom)
+        return NULL;
+    Instance *inst = deque->slots[top & (GC_DEQUE_SIZE - 1)];
+    if (!atomic_cas_i64(&deque->top, top, top + 1))
+        return NULL;
+    return inst;
+}
+
+EXPORT void runtime_show_instance(RuntimeState *state, Instance **instance)
+{
+    Instance *inst = *instance;
+    if (!inst)
+        return;
+    if (state->gc_mode == GC_MODE_MINOR)
+    {
+        if (!(inst->gc_flags & GC_OLD))
+            *instance = gc_evacuate(state, inst);
+        return;
+    }
+    // The mark test waits until gc_drain pops the instance, by which time
+    // this prefetch has usually brought its header in.
+    gc_prefetch(inst);
+    if (gc_worker)
+        gc_deque_push(gc_worker, inst);
+    else
+        arrput(state->gc_worklist, inst);
+}
+
+// Barrier slow path while an incremental cycle marks: an old instance just
+// stored into a field turns grey so the cycle cannot miss it.
+EXPORT void runtime_shade(RuntimeState *state, Instance *instance)
+{
+    if (!instance || !(instance->gc_flags & GC_OLD) || gc_is_marked(state, instance))
         return;
     arrput(state->gc_worklist, instance);
 }
 
+EXPORT void runtime_remember(RuntimeState *state, Instance *instance)
+{
+    if (instance->gc_flags & GC_REMEMBERED)
+        return;
+    instance->gc_flags |= GC_REMEMBERED;
+    arrput(state->remembered, instance);
+}
+
+EXPORT void runtime_remember_statics(RuntimeState *state, Definition *definition)
+{
+    if (definition->statics_remembered)
+        return;
+    definition->statics_remembered = true;
+    arrput(state->remembered_statics, definition);
+}
+
 static volatile double gc_time = 0;
+static volatile double gc_max_pause = 0;
+// Pauses the collector chose to take, in GC_PAUSE_BUCKET ms buckets; the
+// last bucket also holds everything longer. Collections the program forces
+// are only counted in gc_forced.
+#define GC_PAUSE_BUCKET 0.1
+#define GC_PAUSE_BUCKETS 1000
+static unsigned gc_pauses[GC_PAUSE_BUCKETS];
+static unsigned gc_pause_count = 0;
+static unsigned gc_forced = 0;
+static bool gc_forcing = false;
 
-static void runtime_gc_collect(RuntimeState *state)
+static void gc_pause_end(double start)
 {
-    double start = time_ms();
-    arrfree(state->gc_worklist);
-    state->gc_worklist = NULL;
+    double pause = time_ms() - start;
+    gc_time += pause;
+    if (pause > gc_max_pause)
+        gc_max_pause = pause;
+    if (gc_forcing)
+    {
+        gc_forced++;
+        return;
+    }
+    int bucket = (int)(pause / GC_PAUSE_BUCKET);
+    gc_pauses[bucket < GC_PAUSE_BUCKETS ? bucket : GC_PAUSE_BUCKETS - 1]++;
+    gc_pause_count++;
+}
+
+// Upper bound of the bucket the given fraction of pauses falls within.
+static double gc_pause_percentile(double fraction)
+{
+    unsigned target = (unsigned)(fraction * gc_pause_count), seen = 0;
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++)
+    {
+        seen += gc_pauses[i];
+        if (seen > target)
+            return (i + 1) * GC_PAUSE_BUCKET;
+    }
+    return GC_PAUSE_BUCKETS * GC_PAUSE_BUCKET;
+}
+
+static int gc_compare_words(const void *a, const void *b)
+{
+    uintptr_t x = *(const uintptr_t *)a;
+    uintptr_t y = *(const uintptr_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void gc_chunk_bounds(NurseryChunk **chunks, uintptr_t *low, uintptr_t *high)
+{
+    for (int i = 0; i < arrlen(chunks); i++)
+    {
+        if ((uintptr_t)chunks[i]->start < *low)
+            *low = (uintptr_t)chunks[i]->start;
+        if ((uintptr_t)chunks[i]->top > *high)
+            *high = (uintptr_t)chunks[i]->top;
+    }
+}
+
+// Walks from this frame up to stack_base. Its caller has spilled the
+// registers into its own frame, which sits above this one.
+static NOINLINE void gc_scan_words(RuntimeState *state, uintptr_t low, uintptr_t high)
+{
+    uintptr_t here = 0;
+    uintptr_t *word = (uintptr_t *)&here;
+    uintptr_t *end = (uintptr_t *)state->stack_base;
+    for (; word < end; word++)
+    {
+        uintptr_t value = *(volatile uintptr_t *)word;
+        if (value >= low && value < high)
+            arrput(state->gc_candidates, value);
+    }
+}
+
+// Compiled packages keep temporaries in registers and C stack slots that are
+// not frame roots, so the stack is scanned conservatively: any word that
+// points into a nursery chunk pins the instance it lands in for this cycle.
+// glibc mangles the stack and frame pointers it stores in a jmp_buf, so on
+// GCC and Clang the callee-saved registers are spilled explicitly instead.
+static NOINLINE void gc_scan_stack(RuntimeState *state, uintptr_t low, uintptr_t high)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_unwind_init();
+#else
+    jmp_buf registers;
+    setjmp(registers);
+#endif
+    arrsetlen(state->gc_candidates, 0);
+    gc_scan_words(state, low, high);
+    qsort(state->gc_candidates, arrlen(state->gc_candidates), sizeof(uintptr_t), gc_compare_words);
+}
+
+static void gc_pin(RuntimeState *state, NurseryChunk *chunk, Instance *inst)
+{
+    if (state->gc_mode == GC_MODE_MINOR)
+    {
+        if (inst->gc_flags & GC_PINNED)
+            return;
+        inst->gc_flags |= GC_OLD | GC_PINNED;
+        inst->seen = gc_fresh_mark(state);
+        chunk->pinned++;
+        arrput(state->instances, inst);
+        arrput(state->gc_promoted, inst);
+    }
+    else if (inst->gc_flags & GC_PINNED)
+        arrput(state->gc_worklist, inst);
+}
+
+// Full collections also treat stack words pointing at allocated slab slots
+// as roots, so old instances held only by temporaries survive.
+static void heap_mark_candidates(RuntimeState *state)
+{
+    for (int i = 0; i < arrlen(state->gc_candidates); i++)
+    {
+        uintptr_t address = state->gc_candidates[i];
+        HeapPage *page = heap_find_page(state, address);
+        if (!page || address < (uintptr_t)page->objects)
+            continue;
+        uint32_t slot = heap_slot(page, (void *)address);
+        if (slot >= page->capacity || !heap_bit(page->used, slot))
+            continue;
+        arrput(state->gc_worklist, (Instance *)(page->objects + (size_t)slot * page->object_size));
+    }
+}
+
+// Collects the large instances in address order and widens [low, high) to
+// cover them, so the stack scan keeps the words that point into one.
+static void large_bounds(RuntimeState *state, uintptr_t *low, uintptr_t *high)
+{
+    arrsetlen(state->gc_large, 0);
     for (int i = 0; i < arrlen(state->instances); i++)
-        state->instances[i]->seen = false;
-    ReferenceLocal *local = state->locals;
-    while (local)
     {
-        Instance *inst = *local->instance;
-        local = local->prev;
-        if (!inst)
+        Instance *inst = state->instances[i];
+        if (inst && (inst->gc_flags & GC_LARGE))
+            arrput(state->gc_large, inst);
+    }
+    if (arrlen(state->gc_large) == 0)
+        return;
+    qsort(state->gc_large, arrlen(state->gc_large), sizeof(Instance *), gc_compare_words);
+    Instance *last = arrlast(state->gc_large);
+    if ((uintptr_t)state->gc_large[0] < *low)
+        *low = (uintptr_t)state->gc_large[0];
+    if ((uintptr_t)last + gc_object_size(last->definition) > *high)
+        *high = (uintptr_t)last + gc_object_size(last->definition);
+}
+
+// Large instances are calloc'd outside the slab pages, so stack words that
+// land inside one are matched against gc_large. Both lists are sorted, so
+// one merge walk covers them.
+static void large_mark_candidates(RuntimeState *state)
+{
+    int next = 0;
+    for (int i = 0; i < arrlen(state->gc_candidates) && next < arrlen(state->gc_large); i++)
+    {
+        uintptr_t address = state->gc_candidates[i];
+        while (next < arrlen(state->gc_large))
+        {
+            Instance *inst = state->gc_large[next];
+            uintptr_t end = (uintptr_t)inst + gc_object_size(inst->definition);
+            if (address < end)
+                break;
+            next++;
+        }
+        if (next < arrlen(state->gc_large) && address >= (uintptr_t)state->gc_large[next])
+            arrput(state->gc_worklist, state->gc_large[next]);
+    }
+}
+
+// Finalises every allocated slot of the page whose mark bit is clear and
+// rebuilds its free list from what is left.
+static void heap_sweep_page(RuntimeState *state, HeapPage *page)
+{
+    uint64_t flip = state->mark_epoch ? 0 : ~(uint64_t)0;
+    uint32_t words = (page->capacity + 63) / 64;
+    uint32_t live = 0;
+    for (uint32_t w = 0; w < words; w++)
+    {
+        uint64_t marked = page->marks[w] ^ flip;
+        uint64_t dead = page->used[w] & ~marked;
+        while (dead)
+        {
+            uint32_t slot = w * 64 + (uint32_t)bit_ctz64(dead);
+            Instance *inst = (Instance *)(page->objects + (size_t)slot * page->object_size);
+            Definition *def = inst->definition;
+            runtime_sub_alloc(state, def->instance_size);
+            if (def->free)
+                def->free(inst);
+            dead &= dead - 1;
+        }
+        page->used[w] &= marked;
+        live += (uint32_t)bit_popcount64(page->used[w]);
+    }
+    page->live = live;
+    heap_rebuild_free_list(page);
+    heap_make_available(state, page);
+}
+
+// Once every page is swept, empty pages go back to the system and the next
+// full collection is scheduled from what really survived.
+static void heap_sweep_done(RuntimeState *state)
+{
+    for (int i = 0; i < HEAP_SIZE_CLASS_COUNT; i++)
+        state->heap_available[i] = NULL;
+    int kept = 0;
+    for (int i = 0; i < arrlen(state->heap_pages); i++)
+    {
+        HeapPage *page = state->heap_pages[i];
+        if (page->live == 0)
+        {
+            mem_free_aligned(page);
             continue;
-        arrput(state->gc_worklist, inst);
+        }
+        page->available = false;
+        page->next_available = NULL;
+        heap_make_available(state, page);
+        state->heap_pages[kept++] = page;
     }
-    for (int i = 0; i < arrlen(state->definitions); i++)
+    arrsetlen(state->heap_pages, kept);
+    state->gc_threshold = state->allocated_bytes * 2;
+    if (state->gc_threshold < GC_MIN_THRESHOLD)
+        state->gc_threshold = GC_MIN_THRESHOLD;
+    debugprintf("Sweep done %d pages kept\n", kept);
+}
+
+static void heap_sweep_next(RuntimeState *state, int size_class)
+{
+    HeapPage *page = state->heap_unswept[size_class];
+    state->heap_unswept[size_class] = page->next_unswept;
+    page->next_unswept = NULL;
+    heap_sweep_page(state, page);
+    if (--state->heap_unswept_count == 0)
+        heap_sweep_done(state);
+}
+
+// Sweeping is lazy: a full collection only queues every page here, and the
+// dead slots are finalised when their size class runs out of free slots, a
+// few pages per safepoint, or before the next cycle starts marking.
+static void heap_begin_sweep(RuntimeState *state)
+{
+    for (int i = 0; i < HEAP_SIZE_CLASS_COUNT; i++)
     {
-        Definition *def = state->definitions[i];
-        if (def->show_static_refs)
-            def->show_static_refs();
+        state->heap_available[i] = NULL;
+        state->heap_unswept[i] = NULL;
+    }
+    for (int i = 0; i < arrlen(state->heap_pages); i++)
+    {
+        HeapPage *page = state->heap_pages[i];
+        page->available = false;
+        page->next_available = NULL;
+        page->next_unswept = state->heap_unswept[page->size_class];
+        state->heap_unswept[page->size_class] = page;
     }
-    while (arrlen(state->gc_worklist) > 0)
+    state->heap_unswept_count = arrlen(state->heap_pages);
+    if (state->heap_unswept_count == 0)
+        heap_sweep_done(state);
+}
+
+static HeapPage *heap_sweep_class(RuntimeState *state, int size_class)
+{
+    while (!state->heap_available[size_class] && state->heap_unswept[size_class])
+        heap_sweep_next(state, size_class);
+    return state->heap_available[size_class];
+}
+
+// Sweeps up to pages pages, stopping early once deadline passes if it is set.
+static void heap_sweep_step(RuntimeState *state, int pages, double deadline)
+{
+    for (int i = 0; i < HEAP_SIZE_CLASS_COUNT && pages > 0; i++)
+        for (; pages > 0 && state->heap_unswept[i]; pages--)
+        {
+            if (deadline > 0 && time_ms() >= deadline)
+                return;
+            heap_sweep_next(state, i);
+        }
+}
+
+static void heap_finish_sweep(RuntimeState *state)
+{
+    heap_sweep_step(state, state->heap_unswept_count, 0);
+}
+
+// Walks each chunk once alongside the sorted candidates, pinning every
+// instance a candidate points into.
+static void gc_pin_candidates(RuntimeState *state, NurseryChunk **chunks)
+{
+    uintptr_t *candidates = state->gc_candidates;
+    int count = arrlen(candidates);
+    if (count == 0)
+        return;
+    for (int i = 0; i < arrlen(chunks); i++)
     {
-        Instance *inst = arrpop(state->gc_worklist);
+        NurseryChunk *chunk = chunks[i];
+        int lo = 0, hi = count;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (candidates[mid] < (uintptr_t)chunk->start)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        char *p = chunk->start;
+        while (lo < count && candidates[lo] < (uintptr_t)chunk->top && p < chunk->top)
+        {
+            Instance *inst = (Instance *)p;
+            char *next = p + gc_object_size(inst->definition);
+            if (candidates[lo] < (uintptr_t)next)
+            {
+                gc_pin(state, chunk, inst);
+                while (lo < count && candidates[lo] < (uintptr_t)next)
+                    lo++;
+            }
+            p = next;
+        }
+    }
+}
+
+static void gc_unpin(RuntimeState *state, Instance *inst)
+{
+    inst->gc_flags = 0;
+    for (int i = 0; i < arrlen(state->pinned_chunks); i++)
+    {
+        NurseryChunk *chunk = state->pinned_chunks[i];
+        if ((char *)inst < chunk->start || (char *)inst >= chunk->top)
+            continue;
+        if (--chunk->pinned == 0)
+        {
+            free(chunk);
+            arrdelswap(state->pinned_chunks, i);
+        }
+        return;
+    }
+}
+
+// Releases an old instance that lives outside the slab pages.
+static void gc_release(RuntimeState *state, Instance *inst)
+{
+    Definition *def = inst->definition;
+    runtime_sub_alloc(state, def->instance_size);
+    if (def->free)
+        def->free(inst);
+    if (inst->gc_flags & GC_PINNED)
+        gc_unpin(state, inst);
+    else
+        free(inst);
+}
+
+// Pops through a small FIFO so every instance is prefetched a few steps
+// before its mark bit and fields are touched. With a deadline it stops once
+// the slice is used up and returns false if grey instances remain.
+static bool gc_drain(RuntimeState *state, double deadline)
+{
+    Instance *ring[GC_PREFETCH_DISTANCE];
+    int head = 0, count = 0, steps = 0;
+    for (;;)
+    {
+        while (count < GC_PREFETCH_DISTANCE && arrlen(state->gc_worklist) > 0)
+        {
+            Instance *inst = arrpop(state->gc_worklist);
+            if (!inst)
+                continue;
+            gc_prefetch(inst);
+            ring[(head + count) % GC_PREFETCH_DISTANCE] = inst;
+            count++;
+        }
+        if (count == 0)
+        {
+            if (arrlen(state->gc_parts) == 0)
+                return true;
+            GcPart *part = &arrlast(state->gc_parts);
+            part->end = part->instance->definition->show_refs_part(part->instance, part->end, GC_PART_REFS);
+            if (part->end <= 0)
+                arrpop(state->gc_parts);
+            if (deadline > 0 && time_ms() >= deadline)
+                return arrlen(state->gc_worklist) == 0 && arrlen(state->gc_parts) == 0;
+            continue;
+        }
+        if (deadline > 0 && ++steps % GC_SLICE_CHECK_EVERY == 0 && time_ms() >= deadline)
+        {
+            for (; count > 0; count--, head = (head + 1) % GC_PREFETCH_DISTANCE)
+                arrput(state->gc_worklist, ring[head]);
+            return false;
+        }
+        Instance *inst = ring[head];
+        head = (head + 1) % GC_PREFETCH_DISTANCE;
+        count--;
+        // Old instances may point into the nursery mid-cycle; the next minor
+        // collection promotes those and queues them itself.
+        if (!(inst->gc_flags & GC_OLD) || !gc_mark(state, inst))
+            continue;
+        Definition *def = inst->definition;
+        if (def->show_refs_part)
+            arrput(state->gc_parts, ((GcPart){inst, INT_MAX}));
+        else if (def->show_refs)
+            def->show_refs(inst);
+    }
+}
+
+// Own deque first, then the private overflow, then the other workers.
+static Instance *gc_worker_next(GcWorker *worker)
+{
+    Instance *inst = gc_deque_pop(worker);
+    if (inst)
+        return inst;
+    if (arrlen(worker->overflow) > 0)
+    {
+        for (int i = 0; i < GC_DEQUE_SIZE / 2 && arrlen(worker->overflow) > 0; i++)
+            gc_deque_push(worker, arrpop(worker->overflow));
+        return gc_deque_pop(worker);
+    }
+    RuntimeState *state = worker->state;
+    for (int i = 1; i < state->gc_threads; i++)
+    {
+        inst = gc_deque_steal(&state->gc_workers[(worker->index + i) % state->gc_threads]);
+        if (inst)
+            return inst;
+    }
+    return NULL;
+}
+
+// Called with the worker's own queues empty. Marking is over once every
+// worker is idle, since only busy workers can produce more grey instances.
+static bool gc_worker_idle(GcWorker *worker)
+{
+    RuntimeState *state = worker->state;
+    atomic_add_i32(&state->gc_idle, 1);
+    for (;;)
+    {
+        if (atomic_load_i32(&state->gc_idle) == state->gc_threads)
+            return true;
+        for (int i = 1; i < state->gc_threads; i++)
+        {
+            GcDeque *deque = &state->gc_workers[(worker->index + i) % state->gc_threads].deque;
+            if (atomic_load_i64(&deque->top) < atomic_load_i64(&deque->bottom))
+            {
+                atomic_add_i32(&state->gc_idle, -1);
+                return false;
+            }
+        }
+        thread_yield();
+    }
+}
+
+static void gc_worker_mark(void *arg)
+{
+    GcWorker *worker = (GcWorker *)arg;
+    RuntimeState *state = worker->state;
+    gc_worker = worker;
+    for (;;)
+    {
+        Instance *inst = gc_worker_next(worker);
         if (!inst)
+        {
+            if (gc_worker_idle(worker))
+                break;
+            continue;
+        }
+        if (!(inst->gc_flags & GC_OLD) || !gc_mark_atomic(state, inst))
             continue;
-        inst->seen = true;
         Definition *def = inst->definition;
         if (def->show_refs)
             def->show_refs(inst);
     }
+    gc_worker = NULL;
+}
+
+static void gc_worker_loop(void *arg)
+{
+    GcWorker *worker = (GcWorker *)arg;
+    GcPool *pool = worker->state->gc_pool;
+    int seen = 0;
+    thread_lock(&pool->signal);
+    for (;;)
+    {
+        while (!pool->stop && pool->generation == seen)
+            thread_wait(&pool->signal);
+        if (pool->stop)
+            break;
+        seen = pool->generation;
+        thread_unlock(&pool->signal);
+        gc_worker_mark(worker);
+        thread_lock(&pool->signal);
+        pool->done++;
+        thread_wake_all(&pool->signal);
+    }
+    thread_unlock(&pool->signal);
+}
+
+static bool gc_pool_start(RuntimeState *state)
+{
+    GcPool *pool = (GcPool *)calloc(1, sizeof(GcPool));
+    GcWorker *workers = (GcWorker *)calloc(state->gc_threads, sizeof(GcWorker));
+    if (!pool || !workers)
+    {
+        free(pool);
+        free(workers);
+        return false;
+    }
+    thread_signal_init(&pool->signal);
+    state->gc_pool = pool;
+    state->gc_workers = workers;
+    for (int i = 0; i < state->gc_threads; i++)
+    {
+        workers[i].state = state;
+        workers[i].index = i;
+    }
+    for (int i = 1; i < state->gc_threads; i++)
+    {
+        workers[i].started = thread_start(&workers[i].thread, gc_worker_loop, &workers[i]);
+        if (workers[i].started)
+            pool->started++;
+    }
+    return true;
+}
+
+static void gc_pool_stop(RuntimeState *state)
+{
+    GcPool *pool = state->gc_pool;
+    if (!pool)
+        return;
+    thread_lock(&pool->signal);
+    pool->stop = true;
+    thread_wake_all(&pool->signal);
+    thread_unlock(&pool->signal);
+    for (int i = 1; i < state->gc_threads; i++)
+        if (state->gc_workers[i].started)
+            thread_join(&state->gc_workers[i].thread);
+    for (int i = 0; i < state->gc_threads; i++)
+        arrfree(state->gc_workers[i].overflow);
+    thread_signal_free(&pool->signal);
+    free(state->gc_workers);
+    free(pool);
+    state->gc_workers = NULL;
+    state->gc_pool = NULL;
+}
+
+// Stop-the-world marking of a large heap is shared between gc_threads
+// workers. The grey roots start on worker 0 and spread by stealing.
+static void gc_drain_parallel(RuntimeState *state)
+{
+    if (state->gc_threads <= 1 || arrlen(state->heap_pages) < GC_PARALLEL_MIN_PAGES)
+    {
+        gc_drain(state, 0);
+        return;
+    }
+    if (!state->gc_pool && !gc_pool_start(state))
+    {
+        gc_drain(state, 0);
+        return;
+    }
+    // Parts left over from incremental slices are shown whole here.
+    while (arrlen(state->gc_parts) > 0)
+    {
+        GcPart part = arrpop(state->gc_parts);
+        part.instance->definition->show_refs_part(part.instance, part.end, part.end);
+    }
+    GcPool *pool = state->gc_pool;
+    GcWorker *first = &state->gc_workers[0];
+    for (int i = 0; i < arrlen(state->gc_worklist); i++)
+        if (state->gc_worklist[i])
+            gc_deque_push(first, state->gc_worklist[i]);
+    arrsetlen(state->gc_worklist, 0);
+    // A worker that failed to start holds no work, so it just counts as idle.
+    state->gc_idle = state->gc_threads - 1 - pool->started;
+    thread_lock(&pool->signal);
+    pool->done = 0;
+    pool->generation++;
+    thread_wake_all(&pool->signal);
+    thread_unlock(&pool->signal);
+    gc_worker_mark(first);
+    thread_lock(&pool->signal);
+    while (pool->done < pool->started)
+        thread_wait(&pool->signal);
+    thread_unlock(&pool->signal);
+}
+
+// Sets the number of stop-the-world markers, 0 for one per core, and returns
+// the previous count. More markers than cores would only take turns spinning
+// on each other's deques, so the count is capped there. The pool is restarted
+// at the next full collection.
+EXPORT int runtime_gc_threads(RuntimeState *state, int threads)
+{
+    int previous = state->gc_threads;
+    int cores = thread_cpu_count();
+    if (threads <= 0 || threads > cores)
+        threads = cores;
+    if (threads != previous)
+    {
+        gc_pool_stop(state);
+        state->gc_threads = threads;
+    }
+    return previous;
+}
+
+// Minor collection: only the nursery, the roots and the remembered set are
+// visited. Survivors are copied into the old space unless the stack pins them,
+// in which case they are promoted in place and their chunk is retired.
+// With a pause budget the nursery is sized so that a minor collection takes
+// about half of it, leaving the rest of a slice to marking. The estimate is
+// the cost per byte of the last minor collection; it may at most double the
+// size at once, since the survival rate of the next phase is unknown.
+static void nursery_resize(RuntimeState *state, size_t collected, double elapsed)
+{
+    if (state->gc_pause_budget <= 0)
+        return;
+    size_t limit = state->nursery_limit * 2;
+    if (elapsed > 0)
+    {
+        double fit = (double)collected * (state->gc_pause_budget / 2) / elapsed;
+        if (fit < (double)limit)
+            limit = (size_t)fit / NURSERY_CHUNK_SIZE * NURSERY_CHUNK_SIZE;
+    }
+    if (limit > NURSERY_SIZE)
+        limit = NURSERY_SIZE;
+    if (limit < NURSERY_MIN_SIZE)
+        limit = NURSERY_MIN_SIZE;
+    state->nursery_limit = limit;
+}
+
+static void gc_minor(RuntimeState *state)
+{
+    if (arrlen(state->nursery) == 0)
+        return;
+    nursery_sync(state);
+    double start = time_ms();
+    size_t collected = state->nursery_bytes;
+    state->gc_mode = GC_MODE_MINOR;
+    arrsetlen(state->gc_promoted, 0);
+    uintptr_t low = UINTPTR_MAX, high = 0;
+    gc_chunk_bounds(state->nursery, &low, &high);
+    gc_scan_stack(state, low, high);
+    gc_pin_candidates(state, state->nursery);
+
+    for (GcFrame *frame = state->frames; frame; frame = frame->prev)
+        for (int i = 0; i < frame->count; i++)
+            runtime_show_instance(state, &frame->roots[i]);
+    runtime_show_instance(state, &state->exception);
+    for (int i = 0; i < arrlen(state->remembered_statics); i++)
+    {
+        Definition *def = state->remembered_statics[i];
+        def->statics_remembered = false;
+        if (def->show_static_refs)
+            def->show_static_refs();
+    }
+    arrsetlen(state->remembered_statics, 0);
+    for (int i = 0; i < arrlen(state->remembered); i++)
+    {
+        Instance *inst = state->remembered[i];
+        inst->gc_flags &= ~GC_REMEMBERED;
+        if (inst->definition->show_dirty_refs)
+            inst->definition->show_dirty_refs(inst);
+        else if (inst->definition->show_refs)
+            inst->definition->show_refs(inst);
+    }
+    arrsetlen(state->remembered, 0);
+    while (arrlen(state->gc_promoted) > 0)
+    {
+        Instance *inst = arrpop(state->gc_promoted);
+        if (inst->definition->show_refs)
+            inst->definition->show_refs(inst);
+        if (state->gc_marking)
+            arrput(state->gc_worklist, inst);
+    }
+
+    unsigned long long cleaned = 0;
+    for (int i = 0; i < arrlen(state->nursery); i++)
+    {
+        NurseryChunk *chunk = state->nursery[i];
+        for (char *p = chunk->start; p < chunk->top;)
+        {
+            Instance *inst = (Instance *)p;
+            Definition *def = inst->definition;
+            p += gc_object_size(def);
+            if (inst->gc_flags & (GC_FORWARDED | GC_PINNED))
+                continue;
+            runtime_sub_alloc(state, def->instance_size);
+            if (def->free)
+                def->free(inst);
+            cleaned++;
+        }
+        if (chunk->pinned > 0)
+            arrput(state->pinned_chunks, chunk);
+        else
+            arrput(state->nursery_free, chunk);
+    }
+    arrsetlen(state->nursery, 0);
+    state->nursery_bytes = 0;
+    state->alloc_cursor = NULL;
+    state->alloc_limit = NULL;
+    state->gc_mode = GC_MODE_MARK;
+    nursery_resize(state, collected, time_ms() - start);
+    debugprintf("Minor GC done %llu instances cleaned\n", cleaned);
+}
+
+static void runtime_gc_minor(RuntimeState *state)
+{
+    double start = time_ms();
+    gc_minor(state);
+    gc_pause_end(start);
+}
+
+// Greys every root of a full collection: the conservative stack, the frame
+// roots, the pending exception and all static fields.
+static void gc_push_roots(RuntimeState *state)
+{
+    uintptr_t low = UINTPTR_MAX, high = 0;
+    gc_chunk_bounds(state->pinned_chunks, &low, &high);
+    if (arrlen(state->heap_pages) > 0)
+    {
+        if ((uintptr_t)state->heap_pages[0] < low)
+            low = (uintptr_t)state->heap_pages[0];
+        if ((uintptr_t)arrlast(state->heap_pages) + HEAP_PAGE_SIZE > high)
+            high = (uintptr_t)arrlast(state->heap_pages) + HEAP_PAGE_SIZE;
+    }
+    large_bounds(state, &low, &high);
+    gc_scan_stack(state, low, high);
+    gc_pin_candidates(state, state->pinned_chunks);
+    heap_mark_candidates(state);
+    large_mark_candidates(state);
+    for (GcFrame *frame = state->frames; frame; frame = frame->prev)
+        for (int i = 0; i < frame->count; i++)
+            if (frame->roots[i])
+                arrput(state->gc_worklist, frame->roots[i]);
+    if (state->exception)
+        arrput(state->gc_worklist, state->exception);
+    for (int i = 0; i < arrlen(state->definitions); i++)
+    {
+        Definition *def = state->definitions[i];
+        if (def->show_static_refs)
+            def->show_static_refs();
+    }
+}
+
+// Empties the nursery, flips the epoch so every old instance reads white and
+// greys the roots.
+static void gc_start_cycle(RuntimeState *state)
+{
+    gc_minor(state);
+    heap_finish_sweep(state);
+    state->gc_mode = GC_MODE_MARK;
+    arrsetlen(state->gc_worklist, 0);
+    arrsetlen(state->gc_parts, 0);
+    state->mark_epoch = !state->mark_epoch;
+    gc_push_roots(state);
+}
+
+// Finishing step: promotes the nursery (its survivors are queued grey),
+// rescans the unbarriered roots and drains. Marking only ends once a drain
+// runs dry in the same pause as the rescan, so a drain limited to budget ms
+// may return false, and the next attempt rescans again; whatever got marked
+// stays marked. A budget of 0 finishes regardless, on every marker.
+static bool gc_finish_cycle(RuntimeState *state, double budget)
+{
+    gc_minor(state);
+    gc_push_roots(state);
+    if (budget <= 0)
+        gc_drain_parallel(state);
+    else if (!gc_drain(state, time_ms() + budget))
+        return false;
+    state->gc_marking = false;
     unsigned long long cleaned = 0;
     for (int i = 0; i < arrlen(state->instances);)
     {
         Instance *inst = state->instances[i];
-        if (inst && inst->seen)
+        if (inst && inst->seen == state->mark_epoch)
         {
             i++;
             continue;
         }
         if (inst)
         {
-            Definition *def = inst->definition;
-            runtime_sub_alloc(state, def->instance_size);
-            if (def->free)
-                def->free(inst);
+            gc_release(state, inst);
             cleaned++;
         }
         int last = arrlen(state->instances) - 1;
         state->instances[i] = state->instances[last];
         arrpop(state->instances);
     }
-    state->gc_threshold = state->allocated_bytes * 2;
-    double end = time_ms();
-    gc_time += end - start;
-    debugprintf("GC done %llu instances cleaned\n", cleaned);
+    heap_begin_sweep(state);
+    debugprintf("GC done %llu large instances cleaned\n", cleaned);
+    return true;
 }
 
-EXPORT void runtime_gc(RuntimeState *state)
+static void runtime_gc_collect(RuntimeState *state)
 {
-    if (state->allocated_bytes <= state->gc_threshold)
-        return;
-    runtime_gc_collect(state);
+    double start = time_ms();
+    if (!state->gc_marking)
+        gc_start_cycle(state);
+    gc_finish_cycle(state, 0);
+    gc_pause_end(start);
 }
 
-EXPORT void runtime_gc_force(RuntimeState *state)
+// Incremental cycles mark in slices of gc_pause_budget ms and leave the
+// mutator at least as long between slices. A minor collection a slice needs
+// comes out of its budget (nursery_resize keeps one near half of it) and the
+// drain only gets what is left. The attempt to finish gets the rest of the
+// budget after its own minor collection and root rescan.
+// Everything promoted during the cycle survives it, so once the heap has
+// grown a quarter past gc_threshold the slices stop waiting for the mutator.
+// Only if it still reaches half past gc_threshold is the cycle finished in
+// one unbudgeted pause, a fallback as long as a stop-the-world collection.
+static void gc_mark_slice(RuntimeState *state)
 {
-    runtime_gc_collect(state);
+    double start = time_ms();
+    double deadline = start + state->gc_pause_budget;
+    bool behind = state->allocated_bytes > state->gc_threshold + state->gc_threshold / 4;
+    if (state->allocated_bytes > state->gc_threshold + state->gc_threshold / 2)
+        gc_finish_cycle(state, 0);
+    else if (!behind && start - state->gc_slice_end < state->gc_pause_budget)
+    {
+        if (state->nursery_bytes < state->nursery_limit)
+            return;
+        gc_minor(state);
+    }
+    else
+    {
+        if (state->nursery_bytes >= state->nursery_limit)
+            gc_minor(state);
+        if (time_ms() < deadline && gc_drain(state, deadline))
+        {
+            double left = deadline - time_ms();
+            if (left > 0)
+                gc_finish_cycle(state, left);
+        }
+        state->gc_slice_end = time_ms();
+    }
+    gc_pause_end(start);
 }
 
-EXPORT void *runtime_null_coalesce(void *a, void *b)
+// Until the lazy sweep is through, gc_threshold still reflects the last
+// cycle, so safepoints keep sweeping instead of starting a new one. With a
+// pause budget a step sweeps page by page until the budget is spent. A full
+// nursery is collected at a safepoint of its own, not in the same pause.
+static void gc_sweep_slice(RuntimeState *state)
 {
-    return a ? a : b;
+    double start = time_ms();
+    if (state->gc_pause_budget > 0)
+        heap_sweep_step(state, state->heap_unswept_count, start + state->gc_pause_budget);
+    else
+        heap_sweep_step(state, GC_SWEEP_STEP_PAGES, 0);
+    gc_pause_end(start);
+}
+
+// Safepoints only call runtime_gc while gc_pending is set, so it has to stay
+// set for as long as any of the branches below has work to do.
+static void gc_update_pending(RuntimeState *state)
+{
+    state->gc_pending = state->gc_marking || state->heap_unswept_count > 0 ||
+                        state->allocated_bytes > state->gc_threshold ||
+                        state->nursery_bytes >= state->nursery_limit;
+}
+
+EXPORT void runtime_gc(RuntimeState *state)
+{
+    if (state->gc_marking)
+        gc_mark_slice(state);
+    else if (state->heap_unswept_count > 0 && state->nursery_bytes >= state->nursery_limit)
+        runtime_gc_minor(state);
+    else if (state->heap_unswept_count > 0)
+        gc_sweep_slice(state);
+    else if (state->allocated_bytes > state->gc_threshold)
+    {
+        if (state->gc_pause_budget <= 0)
+            runtime_gc_collect(state);
+        else
+        {
+            double start = time_ms();
+            gc_start_cycle(state);
+            state->gc_marking = true;
+            state->gc_slice_end = time_ms();
+            gc_pause_end(start);
+        }
+    }
+    else if (state->nursery_bytes >= state->nursery_limit)
+        runtime_gc_minor(state);
+    gc_update_pending(state);
+}
+
+EXPORT void runtime_gc_force(RuntimeState *state)
+{
+    gc_forcing = true;
+    runtime_gc_collect(state);
+    gc_forcing = false;
+    gc_update_pending(state);
 }
 
 EXPORT void *runtime_unwrap(void *a, int line)
@@ -344,6 +1802,8 @@ EXPORT void runtime_add_alloc(RuntimeState *state, size_t size)
     if (!state || size == 0)
         return;
     state->allocated_bytes += size;
+    if (state->allocated_bytes > state->gc_threshold)
+        state->gc_pending = true;
 }
 
 EXPORT void runtime_sub_alloc(RuntimeState *state, size_t size)
@@ -360,15 +1820,13 @@ EXPORT void runtime_throw(RuntimeState *state, Instance *exception)
 {
     if (!state)
         return;
-    if (state->error_catcher)
+    if (!exception)
     {
-        jmp_buf *buf = state->error_catcher->buf;
-        state->error_catcher = state->error_catcher->prev;
-        state->exception = exception;
-        longjmp(*buf, 1);
+        printf("Threw nil. Aborting.\n");
+        abort();
     }
-    printf("Runtime error with no catcher. Aborting.\n");
-    abort();
+    // The caller returns with it pending; generated code checks after every call.
+    state->exception = exception;
 }
 
 EXPORT Instance *runtime_exception(RuntimeState *state)
@@ -380,23 +1838,26 @@ EXPORT Instance *runtime_exception(RuntimeState *state)
 
 int main(int argc, char **argv)
 {
-    volatile RuntimeState *state = runtime_init();
+    RuntimeState *state = runtime_init();
     if (!state)
     {
         printf("Failed to init runtime\n");
         return 1;
     }
+    state->stack_base = (void *)&argc;
     if (argc < 2)
     {
         printf("Usage: runtime <package folder>\n");
         return 1;
     }
     load_packages_from_folder(argv[1], state);
-    volatile jmp_buf buf;
-    volatile ErrorCatcher error_catcher = {0};
-    error_catcher.buf = &buf;
-    state->error_catcher = &error_catcher;
-    volatile bool success = true;
+    const char *missing = bind_pending_imports(state);
+    if (missing)
+    {
+        printf("Missing import %s\n", missing);
+        return 1;
+    }
+    bool success = true;
     for (int i = 0; i < arrlen(state->definitions); i++)
     {
         Definition *def = state->definitions[i];
@@ -406,10 +1867,8 @@ int main(int argc, char **argv)
                 Method *m = &def->methods[j];
                 if (strcmp(m->name, "Main") == 0)
                 {
-                    if (setjmp(buf) == 0)
-                        ((void (*)(void))m->entry)();
-                    else
-                        success = false;
+                    ((void (*)(void))m->entry)();
+                    success = !state->exception;
                     goto exit;
                 }
             }
@@ -428,8 +1887,12 @@ exit:
         else
             printf("Exception: nil.\n");
     }
+    gc_forcing = true;
     runtime_gc_collect(state);
     runtime_free(state);
     printf("GC time: %f ms\n", gc_time);
+    printf("GC max pause: %f ms\n", gc_max_pause);
+    printf("GC pauses: %u, p50 %.1f ms, p99 %.1f ms, p99.9 %.1f ms (%u forced collections left out)\n", gc_pause_count,
+           gc_pause_percentile(0.5), gc_pause_percentile(0.99), gc_pause_percentile(0.999), gc_forced);
     return 0;
 }
@@ -1,20 +1,59 @@
 #pragma once
 #include "runtime.h"
 
+// Text up to STD_STRING_INLINE bytes lives in small, inside the object;
+// longer text is a malloc'd buffer in data. Both are NUL-terminated, and
+// length does not count the NUL. A shared string borrows data from owner,
+// which keeps the buffer alive and alone frees it (a literal's text has no
+// owner and lives forever). Shared strings may be views into the middle of
+// the buffer, so their text is only bounded by length, not by a NUL.
+#define STD_STRING_INLINE 23
+#define STD_STRING_SMALL 0x01
+#define STD_STRING_SHARED 0x02
+
 typedef struct STD_String {
     Definition *definition;
     bool seen;
-    const char *data;
+    uint8_t gc_flags;
+    uint8_t flags;
+    // FNV-1a of the text, 0 until String.Hash first computes it.
+    uint32_t hash;
+    size_t length;
+    union {
+        struct {
+            const char *data;
+            struct STD_String *owner;
+        };
+        char small[STD_STRING_INLINE + 1];
+    };
 } STD_String;
 
 typedef struct STD_Any {
     Definition *definition;
     bool seen;
+    uint8_t gc_flags;
     Instance* f_0;
 } STD_Any;
 
+// cards holds a byte per STD_LIST_CARD entries of an old list, set when a
+// young value is stored there, so minor collections only rescan those.
+#define STD_LIST_CARD 128
+
 typedef struct STD_List {
     Definition *definition;
     bool seen;
+    uint8_t gc_flags;
     STD_Any **data;
+    uint8_t *cards;
 } STD_List;
+
+// Text being appended to, in a malloc'd buffer that grows by doubling and
+// always keeps one byte spare for the NUL ToString adds.
+typedef struct STD_StringBuilder {
+    Definition *definition;
+    bool seen;
+    uint8_t gc_flags;
+    char *data;
+    size_t length;
+    size_t capacity;
+} STD_StringBuilder;
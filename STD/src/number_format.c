@@ -0,0 +1,343 @@
+#include "number_format.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers"): the value and its rounding boundaries are scaled by a
+// cached power of ten into 64 bit fixed point, then digits are generated
+// until they fall between the boundaries. The result always reads back as
+// the same value and is the shortest such text for nearly every input.
+
+typedef struct DiyFp
+{
+    uint64_t f;
+    int e;
+} DiyFp;
+
+typedef struct CachedPower
+{
+    uint64_t f;
+    int e;
+    int k;
+} CachedPower;
+
+static DiyFp diy_sub(DiyFp x, DiyFp y)
+{
+    return (DiyFp){x.f - y.f, x.e};
+}
+
+// Upper 64 bits of the 128 bit product, rounded.
+static DiyFp diy_mul(DiyFp x, DiyFp y)
+{
+    uint64_t x_lo = x.f & 0xFFFFFFFFu;
+    uint64_t x_hi = x.f >> 32;
+    uint64_t y_lo = y.f & 0xFFFFFFFFu;
+    uint64_t y_hi = y.f >> 32;
+    uint64_t p0 = x_lo * y_lo;
+    uint64_t p1 = x_lo * y_hi;
+    uint64_t p2 = x_hi * y_lo;
+    uint64_t p3 = x_hi * y_hi;
+    uint64_t mid = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu) + (UINT64_C(1) << 31);
+    return (DiyFp){p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32), x.e + y.e + 64};
+}
+
+static DiyFp diy_normalize(DiyFp x)
+{
+    while (!(x.f >> 63))
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+// Value and the midpoints to its neighbours, all sharing one exponent.
+// precision and bias describe the binary format the bits come from.
+static void format_boundaries(uint64_t bits, int precision, int bias, DiyFp *minus, DiyFp *value, DiyFp *plus)
+{
+    uint64_t hidden = UINT64_C(1) << (precision - 1);
+    uint64_t fraction = bits & (hidden - 1);
+    int exponent = (int)(bits >> (precision - 1));
+    DiyFp v = exponent == 0 ? (DiyFp){fraction, 1 - bias} : (DiyFp){fraction + hidden, exponent - bias};
+    // The gap below a power of two is half the gap above it.
+    bool lower_closer = fraction == 0 && exponent > 1;
+    DiyFp m_plus = {2 * v.f + 1, v.e - 1};
+    DiyFp m_minus = lower_closer ? (DiyFp){4 * v.f - 1, v.e - 2} : (DiyFp){2 * v.f - 1, v.e - 1};
+    *plus = diy_normalize(m_plus);
+    *minus = (DiyFp){m_minus.f << (m_minus.e - plus->e), plus->e};
+    *value = diy_normalize(v);
+}
+
+// 10^k for k = -300, -292, ..., 324, as normalized 64 bit significands.
+static const CachedPower cached_powers[] = {
+    {0xAB70FE17C79AC6CA, -1060, -300},
+    {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C, -980, -276},
+    {0xD3515C2831559A83, -954, -268},
+    {0x9D71AC8FADA6C9B5, -927, -260},
+    {0xEA9C227723EE8BCB, -901, -252},
+    {0xAECC49914078536D, -874, -244},
+    {0x823C12795DB6CE57, -847, -236},
+    {0xC21094364DFB5637, -821, -228},
+    {0x9096EA6F3848984F, -794, -220},
+    {0xD77485CB25823AC7, -768, -212},
+    {0xA086CFCD97BF97F4, -741, -204},
+    {0xEF340A98172AACE5, -715, -196},
+    {0xB23867FB2A35B28E, -688, -188},
+    {0x84C8D4DFD2C63F3B, -661, -180},
+    {0xC5DD44271AD3CDBA, -635, -172},
+    {0x936B9FCEBB25C996, -608, -164},
+    {0xDBAC6C247D62A584, -582, -156},
+    {0xA3AB66580D5FDAF6, -555, -148},
+    {0xF3E2F893DEC3F126, -529, -140},
+    {0xB5B5ADA8AAFF80B8, -502, -132},
+    {0x87625F056C7C4A8B, -475, -124},
+    {0xC9BCFF6034C13053, -449, -116},
+    {0x964E858C91BA2655, -422, -108},
+    {0xDFF9772470297EBD, -396, -100},
+    {0xA6DFBD9FB8E5B88F, -369, -92},
+    {0xF8A95FCF88747D94, -343, -84},
+    {0xB94470938FA89BCF, -316, -76},
+    {0x8A08F0F8BF0F156B, -289, -68},
+    {0xCDB02555653131B6, -263, -60},
+    {0x993FE2C6D07B7FAC, -236, -52},
+    {0xE45C10C42A2B3B06, -210, -44},
+    {0xAA242499697392D3, -183, -36},
+    {0xFD87B5F28300CA0E, -157, -28},
+    {0xBCE5086492111AEB, -130, -20},
+    {0x8CBCCC096F5088CC, -103, -12},
+    {0xD1B71758E219652C, -77, -4},
+    {0x9C40000000000000, -50, 4},
+    {0xE8D4A51000000000, -24, 12},
+    {0xAD78EBC5AC620000, 3, 20},
+    {0x813F3978F8940984, 30, 28},
+    {0xC097CE7BC90715B3, 56, 36},
+    {0x8F7E32CE7BEA5C70, 83, 44},
+    {0xD5D238A4ABE98068, 109, 52},
+    {0x9F4F2726179A2245, 136, 60},
+    {0xED63A231D4C4FB27, 162, 68},
+    {0xB0DE65388CC8ADA8, 189, 76},
+    {0x83C7088E1AAB65DB, 216, 84},
+    {0xC45D1DF942711D9A, 242, 92},
+    {0x924D692CA61BE758, 269, 100},
+    {0xDA01EE641A708DEA, 295, 108},
+    {0xA26DA3999AEF774A, 322, 116},
+    {0xF209787BB47D6B85, 348, 124},
+    {0xB454E4A179DD1877, 375, 132},
+    {0x865B86925B9BC5C2, 402, 140},
+    {0xC83553C5C8965D3D, 428, 148},
+    {0x952AB45CFA97A0B3, 455, 156},
+    {0xDE469FBD99A05FE3, 481, 164},
+    {0xA59BC234DB398C25, 508, 172},
+    {0xF6C69A72A3989F5C, 534, 180},
+    {0xB7DCBF5354E9BECE, 561, 188},
+    {0x88FCF317F22241E2, 588, 196},
+    {0xCC20CE9BD35C78A5, 614, 204},
+    {0x98165AF37B2153DF, 641, 212},
+    {0xE2A0B5DC971F303A, 667, 220},
+    {0xA8D9D1535CE3B396, 694, 228},
+    {0xFB9B7CD9A4A7443C, 720, 236},
+    {0xBB764C4CA7A44410, 747, 244},
+    {0x8BAB8EEFB6409C1A, 774, 252},
+    {0xD01FEF10A657842C, 800, 260},
+    {0x9B10A4E5E9913129, 827, 268},
+    {0xE7109BFBA19C0C9D, 853, 276},
+    {0xAC2820D9623BF429, 880, 284},
+    {0x80444B5E7AA7CF85, 907, 292},
+    {0xBF21E44003ACDD2D, 933, 300},
+    {0x8E679C2F5E44FF8F, 960, 308},
+    {0xD433179D9C8CB841, 986, 316},
+    {0x9E19DB92B4E31BA9, 1013, 324},
+};
+
+// Scaling puts the product's binary exponent in [ALPHA, GAMMA], so its
+// integer part fits 32 bits.
+#define GRISU_ALPHA -60
+#define GRISU_GAMMA -32
+
+static CachedPower cached_power_for(int e)
+{
+    int f = GRISU_ALPHA - e - 1;
+    // ceil(f * log10(2)).
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    int index = (300 + k + 7) / 8;
+    return cached_powers[index];
+}
+
+static int largest_pow10(uint32_t n, uint32_t *pow10)
+{
+    static const uint32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    int digits = 10;
+    while (digits > 1 && n < powers[digits - 1])
+        digits--;
+    *pow10 = powers[digits - 1];
+    return digits;
+}
+
+// Moves the last digit down while that brings the digits closer to the
+// value and keeps them inside the boundaries.
+static void grisu_round(char *digits, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+{
+    while (rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+    {
+        digits[length - 1]--;
+        rest += ten_k;
+    }
+}
+
+static void grisu_digits(char *digits, int *length, int *decimal_exponent, DiyFp minus, DiyFp value, DiyFp plus)
+{
+    uint64_t delta = diy_sub(plus, minus).f;
+    uint64_t dist = diy_sub(plus, value).f;
+    int shift = -plus.e;
+    uint64_t one = UINT64_C(1) << shift;
+    uint32_t p1 = (uint32_t)(plus.f >> shift);
+    uint64_t p2 = plus.f & (one - 1);
+
+    uint32_t pow10;
+    int n = largest_pow10(p1, &pow10);
+    while (n > 0)
+    {
+        digits[(*length)++] = (char)('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta)
+        {
+            *decimal_exponent += n;
+            grisu_round(digits, *length, dist, delta, rest, (uint64_t)pow10 << shift);
+            return;
+        }
+        pow10 /= 10;
+    }
+
+    int m = 0;
+    for (;;)
+    {
+        p2 *= 10;
+        digits[(*length)++] = (char)('0' + (p2 >> shift));
+        p2 &= one - 1;
+        m++;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta)
+            break;
+    }
+    *decimal_exponent -= m;
+    grisu_round(digits, *length, dist, delta, p2, one);
+}
+
+static int grisu(char *digits, int *decimal_exponent, DiyFp minus, DiyFp value, DiyFp plus)
+{
+    CachedPower cached = cached_power_for(plus.e);
+    DiyFp c = {cached.f, cached.e};
+    DiyFp w = diy_mul(value, c);
+    DiyFp w_minus = diy_mul(minus, c);
+    DiyFp w_plus = diy_mul(plus, c);
+    // One unit in from each side covers the error of the rounded products.
+    DiyFp lower = {w_minus.f + 1, w_minus.e};
+    DiyFp upper = {w_plus.f - 1, w_plus.e};
+    int length = 0;
+    *decimal_exponent = -cached.k;
+    grisu_digits(digits, &length, decimal_exponent, lower, w, upper);
+    return length;
+}
+
+// Lays out length digits worth digits * 10^decimal_exponent in dest, which
+// holds them on entry and has FORMAT_FLOAT_MAX bytes of room.
+static size_t format_layout(char *dest, int length, int decimal_exponent)
+{
+    int k = length;
+    int n = length + decimal_exponent;
+    if (k <= n && n <= 15)
+    {
+        memset(dest + k, '0', (size_t)(n - k));
+        return (size_t)n;
+    }
+    if (0 < n && n <= 15)
+    {
+        memmove(dest + n + 1, dest + n, (size_t)(k - n));
+        dest[n] = '.';
+        return (size_t)k + 1;
+    }
+    if (-4 < n && n <= 0)
+    {
+        memmove(dest + 2 - n, dest, (size_t)k);
+        dest[0] = '0';
+        dest[1] = '.';
+        memset(dest + 2, '0', (size_t)-n);
+        return (size_t)(2 - n + k);
+    }
+    char *at = dest + 1;
+    if (k > 1)
+    {
+        memmove(dest + 2, dest + 1, (size_t)(k - 1));
+        dest[1] = '.';
+        at = dest + 1 + k;
+    }
+    int e = n - 1;
+    *at++ = 'e';
+    *at++ = e < 0 ? '-' : '+';
+    if (e < 0)
+        e = -e;
+    if (e >= 100)
+    {
+        *at++ = (char)('0' + e / 100);
+        e %= 100;
+    }
+    *at++ = (char)('0' + e / 10);
+    *at++ = (char)('0' + e % 10);
+    return (size_t)(at - dest);
+}
+
+// Zero, infinities and NaN read the way %g prints them.
+static size_t format_special(char *dest, double value)
+{
+    const char *text = isnan(value) ? "nan" : signbit(value) ? (isinf(value) ? "-inf" : "-0") : (isinf(value) ? "inf" : "0");
+    size_t length = strlen(text);
+    memcpy(dest, text, length);
+    return length;
+}
+
+size_t format_double(char *dest, double value)
+{
+    if (!isfinite(value) || value == 0)
+        return format_special(dest, value);
+    size_t sign = 0;
+    if (value < 0)
+    {
+        *dest = '-';
+        sign = 1;
+        value = -value;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    DiyFp minus, v, plus;
+    format_boundaries(bits, 53, 1075, &minus, &v, &plus);
+    int decimal_exponent;
+    int length = grisu(dest + sign, &decimal_exponent, minus, v, plus);
+    return sign + format_layout(dest + sign, length, decimal_exponent);
+}
+
+size_t format_float(char *dest, float value)
+{
+    if (!isfinite(value) || value == 0)
+        return format_special(dest, value);
+    size_t sign = 0;
+    if (value < 0)
+    {
+        *dest = '-';
+        sign = 1;
+        value = -value;
+    }
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    DiyFp minus, v, plus;
+    format_boundaries(bits, 24, 150, &minus, &v, &plus);
+    int decimal_exponent;
+    int length = grisu(dest + sign, &decimal_exponent, minus, v, plus);
+    return sign + format_layout(dest + sign, length, decimal_exponent);
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest text format_double or format_float write: a sign, 17 digits, a
+// point and a three digit exponent, with room to spare.
+#define FORMAT_FLOAT_MAX 32
+
+// Shortest text that reads back as exactly value: plain decimals from 1e-4
+// up to 1e15, scientific past them (%g style, "1e+15", "1.5e-05").
+// No NUL is written; the length is returned.
+size_t format_double(char *dest, double value);
+// The same, shortest at float precision, so 0.1f prints as 0.1.
+size_t format_float(char *dest, float value);
@@ -2,14 +2,16 @@
 #define FUNCTION_VAR
 #include "runtime.h"
 #include "all_types.h"
+#include "string_kernels.h"
+#include "number_format.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <inttypes.h>
-#include <stdarg.h>
 #include <math.h>
 
 static RuntimeState *state = NULL;
@@ -18,13 +20,7 @@ static inline Definition *find_definition(const char *namespace_, const char *na
 {
     if (!state)
         return NULL;
-    for (int i = 0; i < arrlen(state->definitions); i++)
-    {
-        Definition *def = state->definitions[i];
-        if (strcmp(def->namespace_, namespace_) == 0 && strcmp(def->name, name) == 0)
-            return def;
-    }
-    return NULL;
+    return runtime_find_definition(state, namespace_, name);
 }
 
 static inline Definition *ensure_definition(Definition **cache, const char *namespace_, const char *name)
@@ -42,40 +38,30 @@ static inline Definition *ensure_definition(Definition **cache, const char *name
 }
 
 Definition *def_STD_String = NULL;
-Definition *get_STD_String(void)
+static inline Definition *get_STD_String(void)
 {
     return ensure_definition(&def_STD_String, "STD", "String");
 }
 
-EXPORT void getDefinitions(APITable *table);
-
-static STD_String *new_STD_String(void)
+Definition *def_STD_Any = NULL;
+static inline Definition *get_STD_Any(void)
 {
-    STD_String *instance = (STD_String *)malloc(sizeof(STD_String));
-    instance->data = NULL;
-    return instance;
+    return ensure_definition(&def_STD_Any, "STD", "Any");
 }
 
-static STD_Any *new_STD_Any(void)
+Definition *def_STD_List = NULL;
+static inline Definition *get_STD_List(void)
 {
-    STD_Any *instance = (STD_Any *)malloc(sizeof(STD_Any));
-    instance->f_0 = NULL;
-    return instance;
+    return ensure_definition(&def_STD_List, "STD", "List");
 }
 
-static STD_List *new_STD_List(void)
+Definition *def_STD_StringBuilder = NULL;
+static inline Definition *get_STD_StringBuilder(void)
 {
-    STD_List *instance = (STD_List *)malloc(sizeof(STD_List));
-    instance->data = NULL;
-    return instance;
+    return ensure_definition(&def_STD_StringBuilder, "STD", "StringBuilder");
 }
 
-static void free_STD_Any(STD_Any *instance)
-{
-    if (!instance)
-        return;
-    free(instance);
-}
+EXPORT void getDefinitions(APITable *table);
 
 static void free_STD_List(STD_List *instance)
 {
@@ -85,193 +71,449 @@ static void free_STD_List(STD_List *instance)
     {
         size_t cap = (size_t)arrcap(instance->data);
         if (cap > 0)
-            runtime_sub_alloc(state, cap * sizeof(STD_Any *));
+            sub_alloc(state, cap * sizeof(STD_Any *));
         arrfree(instance->data);
         instance->data = NULL;
     }
-    free(instance);
+    arrfree(instance->cards);
 }
 
-static STD_String *STD_String_New(const char *data)
+static inline const char *string_chars(STD_String *string)
 {
-    STD_String *instance = (STD_String *)runtime_new(state, "STD", "String");
-    if (!data)
+    if (!string)
+        return "";
+    if (string->flags & STD_STRING_SMALL)
+        return string->small;
+    return string->data ? string->data : "";
+}
+
+static inline size_t string_length(STD_String *string)
+{
+    return string ? string->length : 0;
+}
+
+static uint32_t string_hash(const char *text, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+    // 0 marks a hash not computed yet.
+    return hash ? hash : 1;
+}
+
+// New string of length bytes, whose text the caller writes into *text along
+// with the NUL. Short text goes inline, so it costs no second allocation.
+static STD_String *string_alloc(size_t length, char **text)
+{
+    STD_String *instance = (STD_String *)runtime_new_def(state, get_STD_String());
+    instance->length = length;
+    if (length <= STD_STRING_INLINE)
     {
-        instance->data = NULL;
+        instance->flags = STD_STRING_SMALL;
+        *text = instance->small;
         return instance;
     }
-
-    size_t len = strlen(data) + 1;
-    char *copy = (char *)malloc(len);
-    memcpy(copy, data, len);
-    instance->data = copy;
-    runtime_add_alloc(state, len);
+    char *data = (char *)malloc(length + 1);
+    instance->data = data;
+    add_alloc(state, length + 1);
+    *text = data;
     return instance;
 }
 
-static STD_String *STD_String_FromString(STD_String *p_0)
+static STD_String *string_from_text(const char *source, size_t length)
 {
-    if (!p_0 || !p_0->data)
-        return STD_String_New("");
-    return STD_String_New(p_0->data);
+    char *text;
+    STD_String *instance = string_alloc(length, &text);
+    memcpy(text, source, length);
+    text[length] = '\0';
+    return instance;
 }
 
-static STD_String *STD_String_Clone(STD_String *p_0)
+static STD_String *STD_String_New(const char *data)
 {
-    return STD_String_FromString(p_0);
+    if (!data)
+        return string_from_text("", 0);
+    return string_from_text(data, strlen(data));
 }
 
-static STD_String *STD_String_Concat(STD_String *p_0, STD_String *p_1)
+// A new string over length bytes of source's buffer from start, with no copy
+// and no allocation charged; the view keeps the buffer's owner alive. A view
+// short enough to go inline is copied instead, which also covers inline
+// sources, whose text moves with their object.
+static STD_String *string_view(STD_String *source, size_t start, size_t length)
 {
-    const char *s0 = (p_0 && p_0->data) ? p_0->data : "";
-    const char *s1 = (p_1 && p_1->data) ? p_1->data : "";
+    if (!source || length <= STD_STRING_INLINE)
+        return string_from_text(string_chars(source) + start, length);
+    STD_String *owner = source;
+    if (source->flags & STD_STRING_SHARED)
+        owner = source->owner;
+    else if (source->gc_flags & GC_IMMORTAL)
+        owner = NULL;
+    STD_String *instance = (STD_String *)runtime_new_def(state, get_STD_String());
+    instance->flags = STD_STRING_SHARED;
+    if (length == source->length)
+        instance->hash = source->hash;
+    instance->length = length;
+    instance->data = source->data + start;
+    instance->owner = owner;
+    gc_write_barrier(instance, owner);
+    return instance;
+}
 
-    size_t len0 = strlen(s0);
-    size_t len1 = strlen(s1);
+static STD_String *string_share(STD_String *source)
+{
+    return string_view(source, 0, string_length(source));
+}
 
-    size_t len = len0 + len1 + 1;
-    char *data = (char *)malloc(len);
+static STD_String *STD_String_FromString(STD_String *p_0)
+{
+    return string_share(p_0);
+}
 
-    memcpy(data, s0, len0);
-    memcpy(data + len0, s1, len1);
-    data[len0 + len1] = '\0';
+static STD_String *STD_String_Clone(STD_String *p_0)
+{
+    return string_share(p_0);
+}
 
-    STD_String *instance = STD_String_New(data);
-    free(data);
+static STD_String *STD_String_Concat(STD_String *p_0, STD_String *p_1)
+{
+    size_t len0 = string_length(p_0);
+    size_t len1 = string_length(p_1);
+
+    char *text;
+    STD_String *instance = string_alloc(len0 + len1, &text);
+    memcpy(text, string_chars(p_0), len0);
+    memcpy(text + len0, string_chars(p_1), len1);
+    text[len0 + len1] = '\0';
     return instance;
 }
 
-static STD_String *STD_String_FromFormat(const char *fmt, ...)
+static size_t string_digits(uint64_t value)
 {
-    va_list args;
-    va_start(args, fmt);
+    static const uint64_t powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+        10000000000u, 100000000000u, 1000000000000u, 10000000000000u, 100000000000000u,
+        1000000000000000u, 10000000000000000u, 100000000000000000u, 1000000000000000000u,
+        10000000000000000000u};
+    size_t digits = 1;
+    while (digits < 20 && value >= powers[digits])
+        digits++;
+    return digits;
+}
 
-    va_list args2;
-    va_copy(args2, args);
+// Writes the digits backwards two at a time, each pair copied from a table,
+// so a number takes half as many divisions as it has digits.
+static void string_write_digits(char *dest, uint64_t value, size_t digits)
+{
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    while (value >= 100)
+    {
+        size_t pair = (size_t)(value % 100) * 2;
+        value /= 100;
+        digits -= 2;
+        memcpy(dest + digits, pairs + pair, 2);
+    }
+    if (value >= 10)
+        memcpy(dest + digits - 2, pairs + value * 2, 2);
+    else
+        dest[digits - 1] = (char)('0' + value);
+}
 
-    int needed = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
+static uint64_t string_magnitude(int64_t value)
+{
+    return value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+}
 
-    if (needed < 0)
+static size_t string_part_measure(StringPart *part)
+{
+    switch (part->kind)
     {
-        va_end(args2);
-        return STD_String_New("");
+    case STRING_PART_STRING:
+        return string_length((STD_String *)part->string);
+    case STRING_PART_BOOL:
+        return part->i ? 4 : 5;
+    case STRING_PART_SIGNED:
+        return (part->i < 0) + string_digits(string_magnitude(part->i));
+    case STRING_PART_UNSIGNED:
+        return string_digits(part->u);
+    case STRING_PART_FLOAT:
+        return format_double(part->text, part->d);
+    case STRING_PART_FLOAT32:
+        return format_float(part->text, (float)part->d);
+    case STRING_PART_CHAR:
+        return part->i != 0;
     }
+    return 0;
+}
 
-    size_t len = (size_t)needed + 1;
-    char *buf = (char *)malloc(len);
-    vsnprintf(buf, len, fmt, args2);
-    va_end(args2);
+static void string_part_write(StringPart *part, char *dest)
+{
+    switch (part->kind)
+    {
+    case STRING_PART_STRING:
+        memcpy(dest, string_chars((STD_String *)part->string), part->length);
+        break;
+    case STRING_PART_BOOL:
+        memcpy(dest, part->i ? "true" : "false", part->length);
+        break;
+    case STRING_PART_SIGNED:
+        if (part->i < 0)
+            *dest++ = '-';
+        string_write_digits(dest, string_magnitude(part->i), part->length - (part->i < 0));
+        break;
+    case STRING_PART_UNSIGNED:
+        string_write_digits(dest, part->u, part->length);
+        break;
+    case STRING_PART_FLOAT:
+    case STRING_PART_FLOAT32:
+        memcpy(dest, part->text, part->length);
+        break;
+    case STRING_PART_CHAR:
+        if (part->length)
+            *dest = (char)part->i;
+        break;
+    }
+}
 
-    STD_String *instance = STD_String_New(buf);
-    free(buf);
+// A whole concatenation chain or interpolated string at once: every part is
+// measured first, so the result is allocated exactly once. Integers are
+// written straight into it; floats are formatted once, while measuring.
+static STD_String *STD_String_Build(StringPart *parts, int32_t count)
+{
+    size_t len = 0;
+    for (int32_t i = 0; i < count; i++)
+    {
+        parts[i].length = string_part_measure(&parts[i]);
+        len += parts[i].length;
+    }
+    char *dest;
+    STD_String *instance = string_alloc(len, &dest);
+    for (int32_t i = 0; i < count; i++)
+    {
+        if (parts[i].length)
+            string_part_write(&parts[i], dest);
+        dest += parts[i].length;
+    }
+    *dest = '\0';
     return instance;
 }
 
+// One value formatted straight into its new string.
+static STD_String *string_from_part(StringPart part)
+{
+    return STD_String_Build(&part, 1);
+}
+
 static STD_String *STD_String_FromBool(bool p_0)
 {
-    return STD_String_New(p_0 ? "true" : "false");
+    return p_0 ? string_from_text("true", 4) : string_from_text("false", 5);
 }
 
 static STD_String *STD_String_FromInt(int32_t p_0)
 {
-    return STD_String_FromFormat("%" PRId32, p_0);
+    return string_from_part((StringPart){STRING_PART_SIGNED, 0, .i = p_0});
 }
 
 static STD_String *STD_String_FromUInt(uint32_t p_0)
 {
-    return STD_String_FromFormat("%" PRIu32, p_0);
+    return string_from_part((StringPart){STRING_PART_UNSIGNED, 0, .u = p_0});
 }
 
 static STD_String *STD_String_FromLong(int64_t p_0)
 {
-    return STD_String_FromFormat("%" PRId64, p_0);
+    return string_from_part((StringPart){STRING_PART_SIGNED, 0, .i = p_0});
 }
 
 static STD_String *STD_String_FromULong(uint64_t p_0)
 {
-    return STD_String_FromFormat("%" PRIu64, p_0);
+    return string_from_part((StringPart){STRING_PART_UNSIGNED, 0, .u = p_0});
 }
 
 static STD_String *STD_String_FromFloat(float p_0)
 {
-    return STD_String_FromFormat("%g", (double)p_0);
+    return string_from_part((StringPart){STRING_PART_FLOAT32, 0, .d = p_0});
 }
 
 static STD_String *STD_String_FromDouble(double p_0)
 {
-    return STD_String_FromFormat("%g", p_0);
+    return string_from_part((StringPart){STRING_PART_FLOAT, 0, .d = p_0});
 }
 
 static STD_String *STD_String_FromByte(uint8_t p_0)
 {
-    return STD_String_FromFormat("%" PRIu8, p_0);
+    return string_from_part((StringPart){STRING_PART_UNSIGNED, 0, .u = p_0});
 }
 
 static STD_String *STD_String_FromSByte(int8_t p_0)
 {
-    return STD_String_FromFormat("%" PRId8, p_0);
+    return string_from_part((StringPart){STRING_PART_SIGNED, 0, .i = p_0});
 }
 
 static STD_String *STD_String_FromChar(char p_0)
 {
-    char buf[2];
-    buf[0] = p_0;
-    buf[1] = '\0';
-    return STD_String_New(buf);
+    return string_from_text(&p_0, p_0 != '\0');
 }
 
 static STD_String *STD_String_FromShort(int16_t p_0)
 {
-    return STD_String_FromFormat("%" PRId16, p_0);
+    return string_from_part((StringPart){STRING_PART_SIGNED, 0, .i = p_0});
 }
 
 static STD_String *STD_String_FromUShort(uint16_t p_0)
 {
-    return STD_String_FromFormat("%" PRIu16, p_0);
+    return string_from_part((StringPart){STRING_PART_UNSIGNED, 0, .u = p_0});
 }
 
 static int32_t STD_String_Length(STD_String *p_0)
 {
-    if (!p_0 || !p_0->data)
-        return 0;
-    return (int32_t)strlen(p_0->data);
+    return (int32_t)string_length(p_0);
 }
 
 static bool STD_String_IsEmpty(STD_String *p_0)
 {
-    if (!p_0 || !p_0->data)
-        return true;
-    return p_0->data[0] == '\0';
+    return string_length(p_0) == 0;
+}
+
+static int32_t STD_String_Hash(STD_String *p_0)
+{
+    if (!p_0)
+        return 0;
+    if (!p_0->hash)
+        p_0->hash = string_hash(string_chars(p_0), p_0->length);
+    return (int32_t)p_0->hash;
 }
 
+// Strings of different lengths, or whose cached hashes differ, are unequal
+// without looking at their text.
 static bool STD_String_Equals(STD_String *p_0, STD_String *p_1)
 {
-    const char *s0 = (p_0 && p_0->data) ? p_0->data : "";
-    const char *s1 = (p_1 && p_1->data) ? p_1->data : "";
-    return strcmp(s0, s1) == 0;
+    if (p_0 == p_1)
+        return true;
+    size_t len = string_length(p_0);
+    if (len != string_length(p_1))
+        return false;
+    if (len > 0 && p_0->hash && p_1->hash && p_0->hash != p_1->hash)
+        return false;
+    return string_kernels.equal(string_chars(p_0), string_chars(p_1), len);
 }
 
 static int32_t STD_String_Compare(STD_String *p_0, STD_String *p_1)
 {
-    const char *s0 = (p_0 && p_0->data) ? p_0->data : "";
-    const char *s1 = (p_1 && p_1->data) ? p_1->data : "";
-    int r = strcmp(s0, s1);
-    if (r < 0)
+    size_t len0 = string_length(p_0);
+    size_t len1 = string_length(p_1);
+    int r = string_kernels.compare(string_chars(p_0), string_chars(p_1), len0 < len1 ? len0 : len1);
+    if (r == 0)
+        r = (len0 > len1) - (len0 < len1);
+    return r;
+}
+
+// Offset of the first needle in text at or after from, or -1.
+static ptrdiff_t string_find(const char *text, size_t length, const char *needle, size_t needle_length, size_t from)
+{
+    if (needle_length == 0)
+        return from <= length ? (ptrdiff_t)from : -1;
+    if (from >= length)
         return -1;
-    if (r > 0)
-        return 1;
-    return 0;
+    ptrdiff_t at = string_kernels.find(text + from, length - from, needle, needle_length);
+    return at < 0 ? -1 : at + (ptrdiff_t)from;
+}
+
+static size_t string_clamp(STD_String *string, int64_t index)
+{
+    size_t length = string_length(string);
+    if (index < 0)
+        return 0;
+    return (uint64_t)index > length ? length : (size_t)index;
+}
+
+// Slices, substrings, trims and split pieces are views into the parent's
+// buffer; indices out of range are clamped to the string.
+static STD_String *STD_String_Slice(STD_String *p_0, int32_t start, int32_t end)
+{
+    size_t from = string_clamp(p_0, start);
+    size_t to = string_clamp(p_0, end);
+    return string_view(p_0, from, to > from ? to - from : 0);
+}
+
+static STD_String *STD_String_Substring(STD_String *p_0, int32_t start, int32_t length)
+{
+    return STD_String_Slice(p_0, start, (int32_t)(string_clamp(p_0, (int64_t)start + length)));
+}
+
+static int32_t STD_String_IndexOf(STD_String *p_0, STD_String *p_1)
+{
+    return (int32_t)string_find(string_chars(p_0), string_length(p_0), string_chars(p_1), string_length(p_1), 0);
+}
+
+static bool STD_String_Contains(STD_String *p_0, STD_String *p_1)
+{
+    return string_find(string_chars(p_0), string_length(p_0), string_chars(p_1), string_length(p_1), 0) >= 0;
+}
+
+static bool STD_String_StartsWith(STD_String *p_0, STD_String *p_1)
+{
+    size_t len = string_length(p_1);
+    return len <= string_length(p_0) && string_kernels.equal(string_chars(p_0), string_chars(p_1), len);
+}
+
+static int32_t STD_String_Count(STD_String *p_0, char p_1)
+{
+    return (int32_t)string_kernels.count(string_chars(p_0), string_length(p_0), p_1);
+}
+
+static bool STD_String_IsValidUtf8(STD_String *p_0)
+{
+    return string_utf8_valid(string_chars(p_0), string_length(p_0));
+}
+
+static bool string_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static STD_String *STD_String_Trim(STD_String *p_0)
+{
+    const char *text = string_chars(p_0);
+    size_t from = 0;
+    size_t to = string_length(p_0);
+    while (from < to && string_is_space(text[from]))
+        from++;
+    while (to > from && string_is_space(text[to - 1]))
+        to--;
+    if (p_0 && from == 0 && to == p_0->length)
+        return p_0;
+    return string_view(p_0, from, to - from);
+}
+
+// A view holds its whole parent alive; Compact copies it out so a short
+// piece kept for long does not pin a large buffer.
+static STD_String *STD_String_Compact(STD_String *p_0)
+{
+    if (!p_0 || !(p_0->flags & STD_STRING_SHARED) || !p_0->owner || p_0->length >= p_0->owner->length)
+        return p_0;
+    return string_from_text(p_0->data, p_0->length);
 }
 
 static void free_STD_String(STD_String *instance)
 {
     if (!instance)
         return;
+    if (instance->flags & (STD_STRING_SMALL | STD_STRING_SHARED))
+        return;
     if (instance->data)
-        runtime_sub_alloc(state, strlen(instance->data) + 1);
+        sub_alloc(state, instance->length + 1);
     free((void *)instance->data);
-    free(instance);
+    instance->data = NULL;
+}
+
+static void show_refs_STD_String(Instance *instance)
+{
+    STD_String *string = (STD_String *)instance;
+    if (string->flags & STD_STRING_SHARED)
+        runtime_show_instance(state, (Instance **)&string->owner);
 }
 
 static void show_refs_STD_Any(Instance *instance)
@@ -280,12 +522,12 @@ static void show_refs_STD_Any(Instance *instance)
     if (!any)
         return;
     if (any->f_0)
-        runtime_show_instance(state, any->f_0);
+        runtime_show_instance(state, &any->f_0);
 }
 
 static STD_Any *STD_String_Box(STD_String *p_0)
 {
-    STD_Any *any = (STD_Any *)runtime_new(state, "STD", "Any");
+    STD_Any *any = (STD_Any *)runtime_new_def(state, get_STD_Any());
     any->f_0 = (Instance *)p_0;
     return any;
 }
@@ -311,15 +553,62 @@ static void show_refs_STD_List(Instance *instance)
     int len = arrlen(list->data);
     for (int i = 0; i < len; i++)
     {
-        STD_Any *any = list->data[i];
-        if (any)
-            runtime_show_instance(state, (Instance *)any);
+        if (list->data[i])
+            runtime_show_instance(state, (Instance **)&list->data[i]);
+    }
+}
+
+// Shown from the top down: RemoveAt only shifts entries that are already
+// shown onto unshown slots, never the other way round.
+static int show_refs_part_STD_List(Instance *instance, int end, int count)
+{
+    STD_List *list = (STD_List *)instance;
+    int len = arrlen(list->data);
+    if (end > len)
+        end = len;
+    int start = end - count > 0 ? end - count : 0;
+    for (int i = end - 1; i >= start; i--)
+        if (list->data[i])
+            runtime_show_instance(state, (Instance **)&list->data[i]);
+    return start;
+}
+
+static void show_dirty_refs_STD_List(Instance *instance)
+{
+    STD_List *list = (STD_List *)instance;
+    int len = arrlen(list->data);
+    for (int card = 0; card < arrlen(list->cards); card++)
+    {
+        if (!list->cards[card])
+            continue;
+        list->cards[card] = 0;
+        int end = (card + 1) * STD_LIST_CARD < len ? (card + 1) * STD_LIST_CARD : len;
+        for (int i = card * STD_LIST_CARD; i < end; i++)
+            if (list->data[i])
+                runtime_show_instance(state, (Instance **)&list->data[i]);
     }
 }
 
+// Marks the cards of entries from..to of an old list once it may hold a
+// young value there.
+static void list_dirty(STD_List *list, int from, int to)
+{
+    while (arrlen(list->cards) <= to / STD_LIST_CARD)
+        arrput(list->cards, 0);
+    for (int card = from / STD_LIST_CARD; card <= to / STD_LIST_CARD; card++)
+        list->cards[card] = 1;
+}
+
+static inline void list_barrier(STD_List *list, int index, STD_Any *value)
+{
+    if (value && !(value->gc_flags & GC_OLD) && (list->gc_flags & GC_OLD))
+        list_dirty(list, index, index);
+    gc_write_barrier(list, value);
+}
+
 static STD_List *STD_List_New(void)
 {
-    return (STD_List *)runtime_new(state, "STD", "List");
+    return (STD_List *)runtime_new_def(state, get_STD_List());
 }
 
 static void STD_List_Add(STD_List *p_0, STD_Any *p_1)
@@ -328,9 +617,10 @@ static void STD_List_Add(STD_List *p_0, STD_Any *p_1)
         return;
     size_t oldCap = (size_t)arrcap(p_0->data);
     arrput(p_0->data, p_1);
+    list_barrier(p_0, (int)arrlen(p_0->data) - 1, p_1);
     size_t newCap = (size_t)arrcap(p_0->data);
     if (newCap > oldCap)
-        runtime_add_alloc(state, (newCap - oldCap) * sizeof(STD_Any *));
+        add_alloc(state, (newCap - oldCap) * sizeof(STD_Any *));
 }
 
 static int32_t STD_List_Count(STD_List *p_0)
@@ -358,6 +648,7 @@ static void STD_List_Set(STD_List *p_0, int32_t index, STD_Any *value)
     if (index < 0 || index >= len)
         return;
     p_0->data[index] = value;
+    list_barrier(p_0, index, value);
 }
 
 static STD_Any *STD_List_Pop(STD_List *p_0)
@@ -377,6 +668,9 @@ static void STD_List_RemoveAt(STD_List *p_0, int32_t index)
     if (index < 0 || index >= len)
         return;
     arrdel(p_0->data, index);
+    // Entries past index shift down, possibly onto clean cards.
+    if ((p_0->gc_flags & GC_REMEMBERED) && index < len - 1)
+        list_dirty(p_0, index, len - 2);
 }
 
 static void STD_List_Clear(STD_List *p_0)
@@ -385,16 +679,210 @@ static void STD_List_Clear(STD_List *p_0)
         return;
     size_t cap = (size_t)arrcap(p_0->data);
     if (cap > 0)
-        runtime_sub_alloc(state, cap * sizeof(STD_Any *));
+        sub_alloc(state, cap * sizeof(STD_Any *));
     arrfree(p_0->data);
     p_0->data = NULL;
+    arrfree(p_0->cards);
 }
 
-void STD_STD_Print(STD_String *p_0)
+// Pieces between separators, boxed, as views into p_0. An empty separator
+// leaves the string whole.
+static STD_List *STD_String_Split(STD_String *p_0, STD_String *p_1)
+{
+    STD_List *list = STD_List_New();
+    const char *text = string_chars(p_0);
+    size_t length = string_length(p_0);
+    size_t separator = string_length(p_1);
+    if (separator == 0)
+    {
+        STD_List_Add(list, STD_String_Box(string_share(p_0)));
+        return list;
+    }
+    size_t from = 0;
+    for (;;)
+    {
+        ptrdiff_t at = string_find(text, length, string_chars(p_1), separator, from);
+        size_t to = at < 0 ? length : (size_t)at;
+        STD_List_Add(list, STD_String_Box(string_view(p_0, from, to - from)));
+        if (at < 0)
+            return list;
+        from = to + separator;
+    }
+}
+
+static void free_STD_StringBuilder(STD_StringBuilder *instance)
+{
+    if (!instance || !instance->data)
+        return;
+    sub_alloc(state, instance->capacity);
+    free(instance->data);
+    instance->data = NULL;
+}
+
+// Room for extra more bytes after the text, plus the NUL. Capacity doubles,
+// so appending n bytes one piece at a time copies O(n) bytes in all.
+static char *builder_reserve(STD_StringBuilder *builder, size_t extra)
+{
+    size_t needed = builder->length + extra + 1;
+    if (needed > builder->capacity)
+    {
+        size_t capacity = builder->capacity ? builder->capacity * 2 : 64;
+        while (capacity < needed)
+            capacity *= 2;
+        builder->data = (char *)realloc(builder->data, capacity);
+        add_alloc(state, capacity - builder->capacity);
+        builder->capacity = capacity;
+    }
+    return builder->data + builder->length;
+}
+
+// Values are formatted the way MathC.ToString and fused Concat chains
+// format them, straight into the buffer.
+static void builder_append_part(STD_StringBuilder *builder, StringPart part)
+{
+    if (!builder)
+        return;
+    part.length = string_part_measure(&part);
+    char *dest = builder_reserve(builder, part.length);
+    if (part.length)
+        string_part_write(&part, dest);
+    builder->length += part.length;
+}
+
+static STD_StringBuilder *STD_StringBuilder_New(void)
+{
+    return (STD_StringBuilder *)runtime_new_def(state, get_STD_StringBuilder());
+}
+
+static STD_StringBuilder *STD_StringBuilder_WithCapacity(int32_t p_0)
+{
+    STD_StringBuilder *builder = STD_StringBuilder_New();
+    if (p_0 > 0)
+        builder_reserve(builder, (size_t)p_0);
+    return builder;
+}
+
+static void STD_StringBuilder_Append(STD_StringBuilder *p_0, STD_String *p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_STRING, 0, .string = (Instance *)p_1});
+}
+
+static void STD_StringBuilder_AppendBool(STD_StringBuilder *p_0, bool p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_BOOL, 0, .i = p_1});
+}
+
+static void STD_StringBuilder_AppendInt(STD_StringBuilder *p_0, int32_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_SIGNED, 0, .i = p_1});
+}
+
+static void STD_StringBuilder_AppendUInt(STD_StringBuilder *p_0, uint32_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_UNSIGNED, 0, .u = p_1});
+}
+
+static void STD_StringBuilder_AppendLong(STD_StringBuilder *p_0, int64_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_SIGNED, 0, .i = p_1});
+}
+
+static void STD_StringBuilder_AppendULong(STD_StringBuilder *p_0, uint64_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_UNSIGNED, 0, .u = p_1});
+}
+
+static void STD_StringBuilder_AppendFloat(STD_StringBuilder *p_0, float p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_FLOAT32, 0, .d = p_1});
+}
+
+static void STD_StringBuilder_AppendDouble(STD_StringBuilder *p_0, double p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_FLOAT, 0, .d = p_1});
+}
+
+static void STD_StringBuilder_AppendByte(STD_StringBuilder *p_0, uint8_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_UNSIGNED, 0, .u = p_1});
+}
+
+static void STD_StringBuilder_AppendSByte(STD_StringBuilder *p_0, int8_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_SIGNED, 0, .i = p_1});
+}
+
+static void STD_StringBuilder_AppendChar(STD_StringBuilder *p_0, char p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_CHAR, 0, .i = p_1});
+}
+
+static void STD_StringBuilder_AppendShort(STD_StringBuilder *p_0, int16_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_SIGNED, 0, .i = p_1});
+}
+
+static void STD_StringBuilder_AppendUShort(STD_StringBuilder *p_0, uint16_t p_1)
+{
+    builder_append_part(p_0, (StringPart){STRING_PART_UNSIGNED, 0, .u = p_1});
+}
+
+static void STD_StringBuilder_AppendLine(STD_StringBuilder *p_0, STD_String *p_1)
+{
+    STD_StringBuilder_Append(p_0, p_1);
+    STD_StringBuilder_AppendChar(p_0, '\n');
+}
+
+static void STD_StringBuilder_AppendNewLine(STD_StringBuilder *p_0)
+{
+    STD_StringBuilder_AppendChar(p_0, '\n');
+}
+
+static int32_t STD_StringBuilder_Length(STD_StringBuilder *p_0)
+{
+    return p_0 ? (int32_t)p_0->length : 0;
+}
+
+static int32_t STD_StringBuilder_Capacity(STD_StringBuilder *p_0)
+{
+    return p_0 ? (int32_t)p_0->capacity : 0;
+}
+
+// Empties the builder but keeps its buffer for the next round of appends.
+static void STD_StringBuilder_Clear(STD_StringBuilder *p_0)
+{
+    if (p_0)
+        p_0->length = 0;
+}
+
+// Hands the text over to the new String and leaves the builder empty. Long
+// text moves as is, trimmed to fit (which allocators do in place), and the
+// builder starts over without a buffer. Short text is copied inline and the
+// builder keeps its buffer.
+static STD_String *STD_StringBuilder_ToString(STD_StringBuilder *p_0)
 {
     if (!p_0 || !p_0->data)
+        return string_from_text("", 0);
+    size_t length = p_0->length;
+    p_0->length = 0;
+    if (length <= STD_STRING_INLINE)
+        return string_from_text(p_0->data, length);
+    char *data = (char *)realloc(p_0->data, length + 1);
+    data[length] = '\0';
+    sub_alloc(state, p_0->capacity - (length + 1));
+    p_0->data = NULL;
+    p_0->capacity = 0;
+    STD_String *instance = (STD_String *)runtime_new_def(state, get_STD_String());
+    instance->length = length;
+    instance->data = data;
+    return instance;
+}
+
+void STD_STD_Print(STD_String *p_0)
+{
+    if (!p_0)
         return;
-    printf("%s\n", p_0->data);
+    printf("%.*s\n", (int)p_0->length, string_chars(p_0));
 }
 
 double STD_STD_TimeMS(void)
@@ -402,6 +890,11 @@ double STD_STD_TimeMS(void)
     return time_ms();
 }
 
+int32_t STD_STD_GcThreads(int32_t p_0)
+{
+    return runtime_gc_threads(state, p_0);
+}
+
 static double STD_Math_Sqrt(double p_0) { return sqrt(p_0); }
 static double STD_Math_Pow(double p_0, double p_1) { return pow(p_0, p_1); }
 static double STD_Math_Sin(double p_0) { return sin(p_0); }
@@ -771,6 +1264,18 @@ static Method STD_String_methods[] = {
     {"Compare", (void *)STD_String_Compare},
     {"Box", (void *)STD_String_Box},
     {"Unbox", (void *)STD_String_Unbox},
+    {"Build", (void *)STD_String_Build},
+    {"Hash", (void *)STD_String_Hash},
+    {"Slice", (void *)STD_String_Slice},
+    {"Substring", (void *)STD_String_Substring},
+    {"IndexOf", (void *)STD_String_IndexOf},
+    {"Split", (void *)STD_String_Split},
+    {"Trim", (void *)STD_String_Trim},
+    {"Compact", (void *)STD_String_Compact},
+    {"Contains", (void *)STD_String_Contains},
+    {"StartsWith", (void *)STD_String_StartsWith},
+    {"Count", (void *)STD_String_Count},
+    {"IsValidUtf8", (void *)STD_String_IsValidUtf8},
 };
 
 static Method STD_List_methods[] = {
@@ -784,9 +1289,34 @@ static Method STD_List_methods[] = {
     {"Clear", (void *)STD_List_Clear},
 };
 
+static Method STD_StringBuilder_methods[] = {
+    {"New", (void *)STD_StringBuilder_New},
+    {"WithCapacity", (void *)STD_StringBuilder_WithCapacity},
+    {"Append", (void *)STD_StringBuilder_Append},
+    {"Append", (void *)STD_StringBuilder_AppendBool},
+    {"Append", (void *)STD_StringBuilder_AppendInt},
+    {"Append", (void *)STD_StringBuilder_AppendUInt},
+    {"Append", (void *)STD_StringBuilder_AppendLong},
+    {"Append", (void *)STD_StringBuilder_AppendULong},
+    {"Append", (void *)STD_StringBuilder_AppendFloat},
+    {"Append", (void *)STD_StringBuilder_AppendDouble},
+    {"Append", (void *)STD_StringBuilder_AppendByte},
+    {"Append", (void *)STD_StringBuilder_AppendSByte},
+    {"Append", (void *)STD_StringBuilder_AppendChar},
+    {"Append", (void *)STD_StringBuilder_AppendShort},
+    {"Append", (void *)STD_StringBuilder_AppendUShort},
+    {"AppendLine", (void *)STD_StringBuilder_AppendLine},
+    {"AppendLine", (void *)STD_StringBuilder_AppendNewLine},
+    {"Length", (void *)STD_StringBuilder_Length},
+    {"Capacity", (void *)STD_StringBuilder_Capacity},
+    {"Clear", (void *)STD_StringBuilder_Clear},
+    {"ToString", (void *)STD_StringBuilder_ToString},
+};
+
 static Method STD_STD_methods[] = {
     {"Print", (void *)STD_STD_Print},
     {"TimeMS", (void *)STD_STD_TimeMS},
+    {"GcThreads", (void *)STD_STD_GcThreads},
 };
 
 static Method STD_Math_methods[] = {
@@ -1217,9 +1747,8 @@ static Definition definitions[] = {
         .instance_size = sizeof(STD_String),
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = (InitFunc)new_STD_String,
         .free = (FreeFunc)free_STD_String,
-        .show_refs = NULL,
+        .show_refs = show_refs_STD_String,
     },
     {
         .namespace_ = "STD",
@@ -1229,8 +1758,7 @@ static Definition definitions[] = {
         .instance_size = sizeof(STD_Any),
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = (InitFunc)new_STD_Any,
-        .free = (FreeFunc)free_STD_Any,
+        .free = NULL,
         .show_refs = show_refs_STD_Any,
     },
     {
@@ -1241,9 +1769,21 @@ static Definition definitions[] = {
         .instance_size = sizeof(STD_List),
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = (InitFunc)new_STD_List,
         .free = (FreeFunc)free_STD_List,
         .show_refs = show_refs_STD_List,
+        .show_dirty_refs = show_dirty_refs_STD_List,
+        .show_refs_part = show_refs_part_STD_List,
+    },
+    {
+        .namespace_ = "STD",
+        .name = "StringBuilder",
+        .methods = STD_StringBuilder_methods,
+        .method_count = (int)(sizeof(STD_StringBuilder_methods) / sizeof(STD_StringBuilder_methods[0])),
+        .instance_size = sizeof(STD_StringBuilder),
+        .static_data = NULL,
+        .show_static_refs = NULL,
+        .free = (FreeFunc)free_STD_StringBuilder,
+        .show_refs = NULL,
     },
     {
         .namespace_ = "STD",
@@ -1253,7 +1793,6 @@ static Definition definitions[] = {
         .instance_size = 0,
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = NULL,
         .free = NULL,
         .show_refs = NULL,
     },
@@ -1265,7 +1804,6 @@ static Definition definitions[] = {
         .instance_size = 0,
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = NULL,
         .free = NULL,
         .show_refs = NULL,
     },
@@ -1277,7 +1815,6 @@ static Definition definitions[] = {
         .instance_size = 0,
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = NULL,
         .free = NULL,
         .show_refs = NULL,
     },
@@ -1289,7 +1826,6 @@ static Definition definitions[] = {
         .instance_size = 0,
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = NULL,
         .free = NULL,
         .show_refs = NULL,
     },
@@ -1301,7 +1837,6 @@ static Definition definitions[] = {
         .instance_size = 0,
         .static_data = NULL,
         .show_static_refs = NULL,
-        .new = NULL,
         .free = NULL,
         .show_refs = NULL,
     },
@@ -1317,14 +1852,20 @@ EXPORT void getDefinitions(APITable *table)
     runtime_load_package = table->runtime_load_package;
     runtime_new = table->runtime_new;
     runtime_free = table->runtime_free;
-    runtime_new_reference_local = table->runtime_new_reference_local;
     runtime_gc = table->runtime_gc;
     runtime_gc_force = table->runtime_gc_force;
     runtime_add_alloc = table->runtime_add_alloc;
     runtime_sub_alloc = table->runtime_sub_alloc;
     runtime_show_instance = table->runtime_show_instance;
-    runtime_null_coalesce = table->runtime_null_coalesce;
     runtime_unwrap = table->runtime_unwrap;
     runtime_throw = table->runtime_throw;
     runtime_exception = table->runtime_exception;
+    runtime_remember = table->runtime_remember;
+    runtime_remember_statics = table->runtime_remember_statics;
+    runtime_new_def = table->runtime_new_def;
+    runtime_find_definition = table->runtime_find_definition;
+    runtime_shade = table->runtime_shade;
+    runtime_gc_threads = table->runtime_gc_threads;
+
+    string_kernels_init(getenv("DIM_STRING_SIMD"));
 }
@@ -0,0 +1,341 @@
+#include "string_kernels.h"
+#include "platform_cpu.h"
+
+#include <string.h>
+
+#if CPU_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+// Built into every package, but only ever called once the CPU check passed.
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static bool plain_equal(const char *a, const char *b, size_t length)
+{
+    return memcmp(a, b, length) == 0;
+}
+
+static int plain_compare(const char *a, const char *b, size_t length)
+{
+    int r = memcmp(a, b, length);
+    return (r > 0) - (r < 0);
+}
+
+static ptrdiff_t plain_find(const char *text, size_t length, const char *needle, size_t needle_length)
+{
+    if (needle_length > length)
+        return -1;
+    const char *end = text + length - needle_length + 1;
+    for (const char *at = text; at < end; at++)
+    {
+        at = (const char *)memchr(at, needle[0], (size_t)(end - at));
+        if (!at)
+            return -1;
+        if (memcmp(at + 1, needle + 1, needle_length - 1) == 0)
+            return at - text;
+    }
+    return -1;
+}
+
+static size_t plain_count(const char *text, size_t length, char c)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++)
+        count += text[i] == c;
+    return count;
+}
+
+static size_t plain_ascii_prefix(const char *text, size_t length)
+{
+    size_t i = 0;
+    while (i < length && (uint8_t)text[i] < 0x80)
+        i++;
+    return i;
+}
+
+#if CPU_X86_64
+// Index of the lowest set bit of a nonzero movemask.
+static inline size_t lowest_bit(uint64_t mask)
+{
+    return (size_t)__builtin_ctzll(mask);
+}
+
+// Offset of the first byte where a and b differ, or length. Whole 64 byte
+// blocks are checked with one branch, and only a differing block is searched.
+static size_t sse2_mismatch(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64)
+    {
+        __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+        __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 16)), _mm_loadu_si128((const __m128i *)(b + i + 16)));
+        __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 32)), _mm_loadu_si128((const __m128i *)(b + i + 32)));
+        __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 48)), _mm_loadu_si128((const __m128i *)(b + i + 48)));
+        if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3))) != 0xFFFF)
+            break;
+    }
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        uint32_t diff = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFFu;
+        if (diff)
+            return i + lowest_bit(diff);
+    }
+    while (i < length && a[i] == b[i])
+        i++;
+    return i;
+}
+
+static bool sse2_equal(const char *a, const char *b, size_t length)
+{
+    return sse2_mismatch(a, b, length) == length;
+}
+
+static int sse2_compare(const char *a, const char *b, size_t length)
+{
+    size_t at = sse2_mismatch(a, b, length);
+    if (at == length)
+        return 0;
+    return (uint8_t)a[at] < (uint8_t)b[at] ? -1 : 1;
+}
+
+// Candidates are positions whose first and last bytes both match the
+// needle's, 64 at a time; only those get a full comparison.
+static uint32_t sse2_candidates(const char *text, __m128i first, __m128i last, size_t last_offset)
+{
+    __m128i head = _mm_loadu_si128((const __m128i *)text);
+    __m128i tail = _mm_loadu_si128((const __m128i *)(text + last_offset));
+    return (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, head), _mm_cmpeq_epi8(last, tail)));
+}
+
+static ptrdiff_t sse2_find(const char *text, size_t length, const char *needle, size_t needle_length)
+{
+    if (needle_length > length)
+        return -1;
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+    size_t last_offset = needle_length - 1;
+    size_t i = 0;
+    for (; i + last_offset + 64 <= length; i += 64)
+    {
+        uint64_t mask = (uint64_t)sse2_candidates(text + i, first, last, last_offset) |
+                        (uint64_t)sse2_candidates(text + i + 16, first, last, last_offset) << 16 |
+                        (uint64_t)sse2_candidates(text + i + 32, first, last, last_offset) << 32 |
+                        (uint64_t)sse2_candidates(text + i + 48, first, last, last_offset) << 48;
+        for (; mask; mask &= mask - 1)
+        {
+            size_t at = i + lowest_bit(mask);
+            if (needle_length <= 2 || memcmp(text + at + 1, needle + 1, needle_length - 2) == 0)
+                return (ptrdiff_t)at;
+        }
+    }
+    ptrdiff_t at = plain_find(text + i, length - i, needle, needle_length);
+    return at < 0 ? -1 : at + (ptrdiff_t)i;
+}
+
+// Matches add up in byte lanes, which are folded into the total before
+// they can wrap at 255.
+static size_t sse2_count(const char *text, size_t length, char c)
+{
+    __m128i match = _mm_set1_epi8(c);
+    __m128i zero = _mm_setzero_si128();
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 16 <= length)
+    {
+        size_t end = i + 255 * 16 < length ? i + 255 * 16 : length;
+        __m128i lanes = zero;
+        for (; i + 16 <= end; i += 16)
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text + i)), match));
+        __m128i sums = _mm_sad_epu8(lanes, zero);
+        count += (size_t)_mm_cvtsi128_si64(sums) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+    }
+    return count + plain_count(text + i, length - i, c);
+}
+
+static size_t sse2_ascii_prefix(const char *text, size_t length)
+{
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(text + i)));
+        if (mask)
+            return i + lowest_bit(mask);
+    }
+    return i + plain_ascii_prefix(text + i, length - i);
+}
+
+TARGET_AVX2 static size_t avx2_mismatch(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128)
+    {
+        __m256i d0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+        __m256i d1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 32)), _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+        __m256i d2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 64)), _mm256_loadu_si256((const __m256i *)(b + i + 64)));
+        __m256i d3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 96)), _mm256_loadu_si256((const __m256i *)(b + i + 96)));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(d0, d1), _mm256_or_si256(d2, d3));
+        if (!_mm256_testz_si256(any, any))
+            break;
+    }
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        uint32_t diff = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (diff)
+            return i + lowest_bit(diff);
+    }
+    return i + sse2_mismatch(a + i, b + i, length - i);
+}
+
+TARGET_AVX2 static bool avx2_equal(const char *a, const char *b, size_t length)
+{
+    return avx2_mismatch(a, b, length) == length;
+}
+
+TARGET_AVX2 static int avx2_compare(const char *a, const char *b, size_t length)
+{
+    size_t at = avx2_mismatch(a, b, length);
+    if (at == length)
+        return 0;
+    return (uint8_t)a[at] < (uint8_t)b[at] ? -1 : 1;
+}
+
+TARGET_AVX2 static uint32_t avx2_candidates(const char *text, __m256i first, __m256i last, size_t last_offset)
+{
+    __m256i head = _mm256_loadu_si256((const __m256i *)text);
+    __m256i tail = _mm256_loadu_si256((const __m256i *)(text + last_offset));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, head), _mm256_cmpeq_epi8(last, tail)));
+}
+
+TARGET_AVX2 static ptrdiff_t avx2_find(const char *text, size_t length, const char *needle, size_t needle_length)
+{
+    if (needle_length > length)
+        return -1;
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+    size_t last_offset = needle_length - 1;
+    size_t i = 0;
+    for (; i + last_offset + 64 <= length; i += 64)
+    {
+        uint64_t mask = (uint64_t)avx2_candidates(text + i, first, last, last_offset) |
+                        (uint64_t)avx2_candidates(text + i + 32, first, last, last_offset) << 32;
+        for (; mask; mask &= mask - 1)
+        {
+            size_t at = i + lowest_bit(mask);
+            if (needle_length <= 2 || memcmp(text + at + 1, needle + 1, needle_length - 2) == 0)
+                return (ptrdiff_t)at;
+        }
+    }
+    ptrdiff_t at = sse2_find(text + i, length - i, needle, needle_length);
+    return at < 0 ? -1 : at + (ptrdiff_t)i;
+}
+
+TARGET_AVX2 static size_t avx2_count(const char *text, size_t length, char c)
+{
+    __m256i match = _mm256_set1_epi8(c);
+    __m256i zero = _mm256_setzero_si256();
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 32 <= length)
+    {
+        size_t end = i + 255 * 32 < length ? i + 255 * 32 : length;
+        __m256i lanes = zero;
+        for (; i + 32 <= end; i += 32)
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(text + i)), match));
+        __m256i sums = _mm256_sad_epu8(lanes, zero);
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        count += (size_t)_mm_cvtsi128_si64(half) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half));
+    }
+    return count + plain_count(text + i, length - i, c);
+}
+
+TARGET_AVX2 static size_t avx2_ascii_prefix(const char *text, size_t length)
+{
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(text + i)));
+        if (mask)
+            return i + lowest_bit(mask);
+    }
+    return i + sse2_ascii_prefix(text + i, length - i);
+}
+#endif
+
+static const StringKernels plain_kernels = {"plain", plain_equal, plain_compare, plain_find, plain_count, plain_ascii_prefix};
+#if CPU_X86_64
+static const StringKernels sse2_kernels = {"sse2", sse2_equal, sse2_compare, sse2_find, sse2_count, sse2_ascii_prefix};
+static const StringKernels avx2_kernels = {"avx2", avx2_equal, avx2_compare, avx2_find, avx2_count, avx2_ascii_prefix};
+#endif
+
+StringKernels string_kernels = {"plain", plain_equal, plain_compare, plain_find, plain_count, plain_ascii_prefix};
+
+void string_kernels_init(const char *limit)
+{
+    string_kernels = plain_kernels;
+    if (limit && strcmp(limit, "0") == 0)
+        return;
+#if CPU_X86_64
+    if (cpu_has_sse2())
+        string_kernels = sse2_kernels;
+    if (limit && strcmp(limit, "sse2") == 0)
+        return;
+    if (cpu_has_avx2())
+        string_kernels = avx2_kernels;
+#endif
+}
+
+// Strict UTF-8: no overlong forms, no surrogates, nothing past U+10FFFF.
+// ASCII runs are skipped a vector at a time.
+bool string_utf8_valid(const char *text, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)text;
+    size_t i = 0;
+    while (i < length)
+    {
+        uint8_t lead = bytes[i];
+        if (lead < 0x80)
+        {
+            i += string_kernels.ascii_prefix(text + i, length - i);
+            continue;
+        }
+        size_t extra;
+        uint8_t low = 0x80;
+        uint8_t high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF)
+            extra = 1;
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            extra = 2;
+            if (lead == 0xE0)
+                low = 0xA0;
+            else if (lead == 0xED)
+                high = 0x9F;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            extra = 3;
+            if (lead == 0xF0)
+                low = 0x90;
+            else if (lead == 0xF4)
+                high = 0x8F;
+        }
+        else
+            return false;
+        if (length - i - 1 < extra)
+            return false;
+        if (bytes[i + 1] < low || bytes[i + 1] > high)
+            return false;
+        for (size_t k = 2; k <= extra; k++)
+            if ((bytes[i + k] & 0xC0) != 0x80)
+                return false;
+        i += extra + 1;
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Byte kernels under String's comparison and search methods. Every kernel
+// works on lengths, never on NULs, so they run on views as well.
+typedef struct StringKernels
+{
+    const char *name;
+    bool (*equal)(const char *a, const char *b, size_t length);
+    // Sign of the first differing byte, read unsigned like memcmp.
+    int (*compare)(const char *a, const char *b, size_t length);
+    // Offset of the first needle in text, or -1. needle_length is at least 1.
+    ptrdiff_t (*find)(const char *text, size_t length, const char *needle, size_t needle_length);
+    size_t (*count)(const char *text, size_t length, char c);
+    // Bytes before the first one outside ASCII.
+    size_t (*ascii_prefix)(const char *text, size_t length);
+} StringKernels;
+
+extern StringKernels string_kernels;
+
+// Picks the widest kernels the CPU runs: AVX2, SSE2 or plain C. limit caps
+// the choice ("avx2", "sse2" or "0" for plain C), NULL leaves it uncapped.
+void string_kernels_init(const char *limit);
+
+bool string_utf8_valid(const char *text, size_t length);
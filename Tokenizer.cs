@@ -165,9 +165,14 @@ public static class Tokenizer
         if (text == null) throw new ArgumentNullException(nameof(text));
 
         var tokens = new List<Token>(Math.Max(16, text.Length / 8));
+        int line = 1;
+        Tokenize(text, ref line, tokens);
+        return new TokenSet(tokens);
+    }
 
+    static void Tokenize(string text, ref int line, List<Token> tokens)
+    {
         int idx = 0;
-        int line = 1;
 
         while (idx < text.Length)
         {
@@ -214,6 +219,13 @@ public static class Tokenizer
                 continue;
             }
 
+            if (c == '$' && idx + 1 < text.Length && text[idx + 1] == '"')
+            {
+                idx++;
+                ReadInterpolatedString(text, ref idx, ref line, tokens);
+                continue;
+            }
+
             if (LooksLikeNumberStart(text, idx))
             {
                 var value = ReadNumber(text, ref idx);
@@ -237,8 +249,6 @@ public static class Tokenizer
 
             throw new Exception($"Tokenizer error on line {line}: unexpected character '{c}' (0x{((int)c):X2})");
         }
-
-        return new TokenSet(tokens);
     }
 
     static void ConsumeWhitespace(string text, ref int idx, ref int line)
@@ -412,72 +422,155 @@ public static class Tokenizer
         idx++;
         var chars = new List<char>(64);
 
+        while (idx < text.Length)
+        {
+            if (text[idx] == '"')
+            {
+                idx++;
+                return new string(chars.ToArray());
+            }
+            ReadStringChar(text, ref idx, ref line, chars);
+        }
+
+        throw new Exception("Unterminated string literal on");
+    }
+
+    // $"text {expression} text" comes out as a "$\"" symbol, String tokens for
+    // the text, each hole's own tokens between "{" and "}", then a closing
+    // "\"" symbol. "{{" and "}}" stand for literal braces.
+    static void ReadInterpolatedString(string text, ref int idx, ref int line, List<Token> tokens)
+    {
+        if (text[idx] != '"') throw new Exception("ReadInterpolatedString called at non-quote");
+
+        tokens.Add(new Token(line, TokenType.Symbol, "$\""));
+        idx++;
+        var chars = new List<char>(64);
+        int textLine = line;
+
+        void Flush()
+        {
+            if (chars.Count > 0)
+                tokens.Add(new Token(textLine, TokenType.String, new string(chars.ToArray())));
+            chars.Clear();
+        }
+
         while (idx < text.Length)
         {
             char c = text[idx];
 
             if (c == '"')
             {
+                Flush();
+                tokens.Add(new Token(line, TokenType.Symbol, "\""));
                 idx++;
-                return new string(chars.ToArray());
+                return;
             }
 
-            if (c == '\r')
+            if ((c == '{' || c == '}') && idx + 1 < text.Length && text[idx + 1] == c)
             {
-                if (idx + 1 < text.Length && text[idx + 1] == '\n') idx++;
-                line++;
-                chars.Add('\n');
-                idx++;
+                chars.Add(c);
+                idx += 2;
                 continue;
             }
 
-            if (c == '\n')
+            if (c == '}')
+                throw new Exception($"Unmatched '}}' in interpolated string on line {line}");
+
+            if (c == '{')
             {
-                line++;
-                chars.Add('\n');
+                Flush();
+                tokens.Add(new Token(line, TokenType.Symbol, "{"));
+                int start = ++idx;
+                int depth = 0;
+                while (true)
+                {
+                    if (idx >= text.Length)
+                        throw new Exception($"Unterminated hole in interpolated string on line {line}");
+                    char h = text[idx];
+                    if (h == '}' && depth == 0)
+                        break;
+                    if (h == '{')
+                        depth++;
+                    else if (h == '}')
+                        depth--;
+                    if (h == '"')
+                    {
+                        int skipLine = line;
+                        ReadString(text, ref idx, ref skipLine);
+                        continue;
+                    }
+                    idx++;
+                }
+                Tokenize(text.Substring(start, idx - start), ref line, tokens);
+                tokens.Add(new Token(line, TokenType.Symbol, "}"));
                 idx++;
+                textLine = line;
                 continue;
             }
 
-            if (c == '\\')
-            {
-                idx++;
-                if (idx >= text.Length) throw new Exception($"Unterminated escape sequence in string on line {line}");
+            ReadStringChar(text, ref idx, ref line, chars);
+        }
+
+        throw new Exception("Unterminated interpolated string literal");
+    }
+
+    static void ReadStringChar(string text, ref int idx, ref int line, List<char> chars)
+    {
+        char c = text[idx];
+
+        if (c == '\r')
+        {
+            if (idx + 1 < text.Length && text[idx + 1] == '\n') idx++;
+            line++;
+            chars.Add('\n');
+            idx++;
+            return;
+        }
 
-                char e = text[idx];
+        if (c == '\n')
+        {
+            line++;
+            chars.Add('\n');
+            idx++;
+            return;
+        }
 
-                if (e == '\\') { chars.Add('\\'); idx++; continue; }
-                if (e == '"') { chars.Add('"'); idx++; continue; }
-                if (e == 'n') { chars.Add('\n'); idx++; continue; }
-                if (e == 'r') { chars.Add('\r'); idx++; continue; }
-                if (e == 't') { chars.Add('\t'); idx++; continue; }
+        if (c == '\\')
+        {
+            idx++;
+            if (idx >= text.Length) throw new Exception($"Unterminated escape sequence in string on line {line}");
+
+            char e = text[idx];
 
-                if (e == '0')
+            if (e == '\\') { chars.Add('\\'); idx++; return; }
+            if (e == '"') { chars.Add('"'); idx++; return; }
+            if (e == 'n') { chars.Add('\n'); idx++; return; }
+            if (e == 'r') { chars.Add('\r'); idx++; return; }
+            if (e == 't') { chars.Add('\t'); idx++; return; }
+
+            if (e == '0')
+            {
+                if (idx + 3 < text.Length && (text[idx + 1] == 'x' || text[idx + 1] == 'X'))
                 {
-                    if (idx + 3 < text.Length && (text[idx + 1] == 'x' || text[idx + 1] == 'X'))
+                    char h1 = text[idx + 2];
+                    char h2 = text[idx + 3];
+                    if (!IsHexDigit(h1) || !IsHexDigit(h2))
                     {
-                        char h1 = text[idx + 2];
-                        char h2 = text[idx + 3];
-                        if (!IsHexDigit(h1) || !IsHexDigit(h2))
-                        {
-                            throw new Exception("Invalid \\0xHH escape in string");
-                        }
-
-                        int value = (HexValue(h1) << 4) | HexValue(h2);
-                        chars.Add((char)value);
-                        idx += 4;
-                        continue;
+                        throw new Exception("Invalid \\0xHH escape in string");
                     }
-                }
 
-                throw new Exception("Unknown escape sequence \\{e} in string");
+                    int value = (HexValue(h1) << 4) | HexValue(h2);
+                    chars.Add((char)value);
+                    idx += 4;
+                    return;
+                }
             }
 
-            chars.Add(c);
-            idx++;
+            throw new Exception("Unknown escape sequence \\{e} in string");
         }
 
-        throw new Exception("Unterminated string literal on");
+        chars.Add(c);
+        idx++;
     }
 
     static string? TryReadSymbol(string text, ref int idx)
@@ -15,6 +15,150 @@ public static partial class Transpiler
             TranslateExpression(arg);
         }
     }
+    // Methods of this package are called by their C symbol, which the compiler
+    // can inline within a module. Other packages' methods go through the
+    // import table bindImports fills at load time.
+    static void TranslateCall(Class @class, Method method, List<Expression> arguments)
+    {
+        BeginCheckedCall(method.ReturnType);
+        if (packageClasses.Contains(ClassKey(@class)))
+        {
+            C($"{@class.Namespace}_{@class.Name}_{method.Name}(");
+            TranslateArguments(arguments, method.Arguments);
+            C("))");
+            return;
+        }
+        C("import_call(");
+        C($"{BuildFunctionPointerType(method)}, ");
+        C($"{@class.Namespace}_{@class.Name}, ");
+        C($"{method.i}, ");
+        TranslateArguments(arguments, method.Arguments);
+        C("))");
+    }
+    // Every call checks for a pending exception on return, which leaves
+    // through the innermost handler. Close with one more ")".
+    static void BeginCheckedCall(Type? returnType)
+    {
+        if (returnType != null)
+            C($"checked_call({TranslateType(returnType)}, {CurrentHandler}, ");
+        else
+            C($"checked_void_call({CurrentHandler}, ");
+    }
+    // A literal in source parses as STD.String.New("..."); those become
+    // references into the package's static string_literals instead.
+    static bool IsStringLiteral(CallStaticExpression call, out string value)
+    {
+        value = "";
+        if (call.Callee.Namespace != "STD" || call.Callee.Name != "String" || call.Name != "New")
+            return false;
+        if (call.Arguments is not [StringExpression stringExpression])
+            return false;
+        value = stringExpression.Value;
+        return true;
+    }
+    static bool IsStdString(Type type)
+    {
+        if (type is not ClassType classType || TryGetInterface(classType, out _))
+            return false;
+        Class @class = GetClass(classType);
+        return @class.Namespace == "STD" && @class.Name == "String";
+    }
+    static bool IsStringConcat(CallInstanceExpression call)
+        => call.Name == "Concat" && call.Arguments.Count == 2 && IsStdString(GetType(call.Arguments[0])) && IsStdString(GetType(call));
+    // MathC.ToString(value), whose value Build can format itself.
+    static bool IsNumberToString(CallStaticExpression call, out Expression value)
+    {
+        value = call.Arguments.Count == 1 ? call.Arguments[0] : null!;
+        if (call.Name != "ToString" || value == null || value is NumberExpression)
+            return false;
+        Class @class = GetClass(call.Callee);
+        return @class.Namespace == "STD" && @class.Name == "MathC" && GetStringPartKind(value) != null;
+    }
+    // How STD String.Build takes a part: a String, or a value it formats like
+    // MathC.ToString. Null for anything else.
+    static string? GetStringPartKind(Expression part)
+    {
+        if (part is NumberExpression numberExpression)
+            return numberExpression.Value.Contains('.') ? "STRING_PART_FLOAT" : "STRING_PART_SIGNED";
+        Type type = GetType(part);
+        if (type is ValueType valueType)
+            return valueType.Name switch
+            {
+                "bool" => "STRING_PART_BOOL",
+                "sbyte" or "short" or "int" or "long" => "STRING_PART_SIGNED",
+                "byte" or "ushort" or "uint" or "ulong" => "STRING_PART_UNSIGNED",
+                "float" => "STRING_PART_FLOAT32",
+                "double" => "STRING_PART_FLOAT",
+                "char" => "STRING_PART_CHAR",
+                _ => null
+            };
+        return IsStdString(type) ? "STRING_PART_STRING" : null;
+    }
+    // Concat chains and interpolated strings flatten into one list of parts.
+    static void CollectStringParts(Expression expression, List<Expression> parts)
+    {
+        switch (expression)
+        {
+            case CallInstanceExpression call when IsStringConcat(call):
+                CollectStringParts(call.Arguments[0], parts);
+                CollectStringParts(call.Arguments[1], parts);
+                return;
+            case InterpolatedStringExpression interpolated:
+                foreach (var part in interpolated.Parts)
+                    CollectStringParts(part, parts);
+                return;
+            case CallStaticExpression call when IsNumberToString(call, out Expression value):
+                parts.Add(value);
+                return;
+        }
+        parts.Add(expression);
+    }
+    // One STD String.Build call for the whole string, so it is allocated once
+    // at its final length instead of once per Concat. Build cannot throw;
+    // only the parts' own calls are checked.
+    static void TranslateStringBuild(Expression expression, bool paren)
+    {
+        List<Expression> parts = new();
+        CollectStringParts(expression, parts);
+        Class @class = GetClass(new ClassType("STD", "String"));
+        Method build = @class.Methods.FirstOrDefault(m => m.Name == "Build") ?? throw new Exception($"STD String has no Build on line {expression.Line}");
+        if (paren)
+            C("(");
+        C($"import_call({BuildFunctionPointerType(build)}, STD_String, {build.i}, ((StringPart[]){{ ");
+        foreach (var part in parts)
+        {
+            string kind = GetStringPartKind(part)!;
+            string field = kind switch
+            {
+                "STRING_PART_STRING" => ".string = (Instance *)",
+                "STRING_PART_UNSIGNED" => ".u = ",
+                "STRING_PART_FLOAT" or "STRING_PART_FLOAT32" => ".d = ",
+                _ => ".i = "
+            };
+            C($"{{ {kind}, 0, {field}");
+            TranslateExpression(part);
+            C(" }, ");
+        }
+        // Parenthesised so the braces' commas survive as one macro argument.
+        C($"}}), {parts.Count})");
+        if (paren)
+            C(")");
+    }
+    // STD's String.Hash (FNV-1a, never 0), so literals start out hashed.
+    static uint StringHash(string value)
+    {
+        uint hash = 2166136261;
+        foreach (byte c in value)
+            hash = unchecked((hash ^ c) * 16777619);
+        return hash != 0 ? hash : 1;
+    }
+    static string EscapeCString(string value)
+    {
+        var sb = new StringBuilder("\"");
+        foreach (byte c in value)
+            sb.Append("\\x").Append(c.ToString("X2"));
+        return sb.Append('"').ToString();
+    }
     static string CaptureExpressionText(Expression expression)
     {
         int start = c.Length;
@@ -30,15 +174,26 @@ public static partial class Transpiler
             case LocalExpression localExpression:
                 if (inlineIsBindings.TryGetValue(localExpression.ID, out var inlineBinding))
                 {
-                    C($"({TranslateType(inlineBinding.target)})");
-                    TranslateExpression(inlineBinding.source);
+                    C($"(({TranslateType(inlineBinding.target)}){inlineBinding.temp})");
                 }
+                else if (TryGetLocalSlot(localExpression.ID, out int localSlot))
+                    C($"frame_root({TranslateType(GetType(localExpression))}, {localSlot})");
                 else
                     C($"l_{localExpression.ID}");
                 break;
             case ArgumentExpression argumentExpression:
-                C($"p_{argumentExpression.ID}");
+                if (argumentSlots.TryGetValue(argumentExpression.ID, out int argumentSlot))
+                    C($"frame_root({TranslateType(arguments[argumentExpression.ID])}, {argumentSlot})");
+                else
+                    C($"p_{argumentExpression.ID}");
                 break;
+            case CallStaticExpression callStaticExpression when IsStringLiteral(callStaticExpression, out string literal):
+                {
+                    if (!State.StringLiterals.TryGetValue(literal, out int index))
+                        State.StringLiterals[literal] = index = State.StringLiterals.Count;
+                    C($"((STD_String *)&string_literals[{index}])");
+                    break;
+                }
             case CallStaticExpression callStaticExpression:
                 {
                     Method? method = callStaticExpression.cachedMethod;
@@ -51,12 +206,7 @@ public static partial class Transpiler
                     }
                     if (paren)
                         C("(");
-                    C("static_method_call(");
-                    C($"{BuildFunctionPointerType(method!)}, ");
-                    C($"{@class!.Namespace}_{@class.Name}, ");
-                    C($"{method!.i}, ");
-                    TranslateArguments(callStaticExpression.Arguments, method!.Arguments);
-                    C(")");
+                    TranslateCall(@class!, method!, callStaticExpression.Arguments);
                     if (paren)
                         C(")");
                     break;
@@ -74,12 +224,7 @@ public static partial class Transpiler
                     }
                     if (paren)
                         C("(");
-                    C("static_method_call(");
-                    C($"{BuildFunctionPointerType(method!)}, ");
-                    C($"{@class!.Namespace}_{@class.Name}, ");
-                    C($"{method!.i}, ");
-                    TranslateArguments(callExpression.Arguments, method!.Arguments);
-                    C(")");
+                    TranslateCall(@class!, method!, callExpression.Arguments);
                     if (paren)
                         C(")");
                     break;
@@ -103,25 +248,21 @@ public static partial class Transpiler
                 }
             case IsExpression isExpression:
                 {
-                    Type left = GetType(isExpression.True);
-                    Type right = GetType(isExpression.False);
-                    if (!TypeMatches(left, right, true))
-                        throw new Exception($"is expression branch type mismatch on line {isExpression.Line}");
-                    string sourceText = CaptureExpressionText(isExpression.Source);
-                    string sourceInstanceExpr = $"((Instance*)({sourceText}))";
-                    if (paren)
-                        C("(");
-                    C(BuildRuntimeTypeCheckExpr(sourceInstanceExpr, isExpression.TargetType));
-                    C(" ? ");
+                    // The source goes into a temporary once; the test and
+                    // every use of the binding read the temporary.
+                    GetType(isExpression);
+                    string tmpName = $"l_is_tmp_{isTempId++}";
+                    C($"({{ Instance* {tmpName} = (Instance*)");
+                    TranslateExpression(isExpression.Source);
+                    C($"; {BuildRuntimeTypeCheckExpr(tmpName, isExpression.TargetType)} ? ");
                     locals.Push(new Dictionary<int, Type> { { isExpression.BindID, isExpression.TargetType } });
-                    inlineIsBindings[isExpression.BindID] = (isExpression.TargetType, isExpression.Source);
+                    inlineIsBindings[isExpression.BindID] = (isExpression.TargetType, tmpName);
                     TranslateExpression(isExpression.True);
                     inlineIsBindings.Remove(isExpression.BindID);
                     locals.Pop();
                     C(" : ");
                     TranslateExpression(isExpression.False);
-                    if (paren)
-                        C(")");
+                    C("; })");
                     break;
                 }
             case AsExpression asExpression:
@@ -129,20 +270,19 @@ public static partial class Transpiler
                     Type sourceType = GetType(asExpression.Source);
                     if (sourceType is not ClassType)
                         throw new Exception($"as source must be class/interface type on line {asExpression.Line}");
-                    string sourceText = CaptureExpressionText(asExpression.Source);
-                    string sourceInstanceExpr = $"((Instance*)({sourceText}))";
+                    string tmpName = $"l_is_tmp_{isTempId++}";
                     string targetType = TranslateType(asExpression.TargetType with { Nullable = true });
-                    if (paren)
-                        C("(");
-                    C($"({targetType})(");
-                    C(BuildRuntimeTypeCheckExpr(sourceInstanceExpr, asExpression.TargetType));
-                    C(" ? ");
-                    C(sourceInstanceExpr);
-                    C(" : NULL)");
-                    if (paren)
-                        C(")");
+                    C($"({{ Instance* {tmpName} = (Instance*)");
+                    TranslateExpression(asExpression.Source);
+                    C($"; ({targetType})({BuildRuntimeTypeCheckExpr(tmpName, asExpression.TargetType)} ? {tmpName} : NULL); }})");
                     break;
                 }
+            case CallInstanceExpression callInstanceExpression when IsStringConcat(callInstanceExpression):
+                TranslateStringBuild(callInstanceExpression, paren);
+                break;
+            case InterpolatedStringExpression interpolatedStringExpression:
+                TranslateStringBuild(interpolatedStringExpression, paren);
+                break;
             case CallInstanceExpression callInstanceExpression:
                 {
                     Type type = GetType(callInstanceExpression.Arguments[0]);
@@ -150,8 +290,20 @@ public static partial class Transpiler
                         throw new Exception($"Cannot call on a non-class type you moron on line {callInstanceExpression.Line}");
                     if (classType.Nullable)
                         throw new Exception($"Cannot call on a nullable type you moron on line {callInstanceExpression.Line}");
-                    if (TryGetInterface(classType, out _))
-                        throw new Exception($"Cannot call instance methods on interface-typed value on line {callInstanceExpression.Line}");
+                    if (TryGetInterface(classType, out var iface))
+                    {
+                        int slot = GetInterfaceSlot(iface!, callInstanceExpression.Name, callInstanceExpression.Arguments, callInstanceExpression.Line);
+                        InterfaceMethod interfaceMethod = iface!.Methods[slot];
+                        if (paren)
+                            C("(");
+                        BeginCheckedCall(interfaceMethod.ReturnType);
+                        C($"icall_{iface.Namespace}_{iface.Name}_{interfaceMethod.Name}(&inline_caches[{State.InlineCaches++}], ");
+                        TranslateArguments(callInstanceExpression.Arguments, [classType, .. interfaceMethod.Arguments]);
+                        C("))");
+                        if (paren)
+                            C(")");
+                        break;
+                    }
                     Method? method = callInstanceExpression.cachedMethod;
                     Class? @class = GetClass(classType);
                     if (method == null)
@@ -162,12 +314,18 @@ public static partial class Transpiler
                     }
                     if (paren)
                         C("(");
-                    C("static_method_call(");
-                    C($"{BuildFunctionPointerType(method!)}, ");
-                    C($"{@class!.Namespace}_{@class.Name}, ");
-                    C($"{method!.i}, ");
-                    TranslateArguments(callInstanceExpression.Arguments, method!.Arguments);
-                    C(")");
+                    Class owner = GetMethodOwner(method!);
+                    if (!method!.Virtual)
+                        TranslateCall(owner, method, callInstanceExpression.Arguments);
+                    else if (TryDevirtualize(GetClass(classType), method, out Method impl))
+                        TranslateCall(GetMethodOwner(impl), impl, callInstanceExpression.Arguments);
+                    else
+                    {
+                        BeginCheckedCall(method.ReturnType);
+                        C($"vcall_{owner.Namespace}_{owner.Name}_{method.Name}(");
+                        TranslateArguments(callInstanceExpression.Arguments, method.Arguments);
+                        C("))");
+                    }
                     if (paren)
                         C(")");
                     break;
@@ -222,13 +380,7 @@ public static partial class Transpiler
                 }
             case StringExpression stringExpression:
                 {
-                    C("\"");
-                    foreach (byte c in stringExpression.Value)
-                    {
-                        C("\\x");
-                        C(c.ToString("X2"));
-                    }
-                    C("\"");
+                    C(EscapeCString(stringExpression.Value));
                     break;
                 }
             case BinaryExpression binaryExpression:
@@ -247,7 +399,7 @@ public static partial class Transpiler
                                 Class @rightClass = GetClass(rightClassType);
                                 if (@leftClass.Namespace != @rightClass.Namespace || @leftClass.Name != @rightClass.Name)
                                     throw new Exception($"Types mismatch on line {binaryExpression.Line}");
-                                C($"({TranslateType(left)})runtime_null_coalesce((void*)");
+                                C($"({TranslateType(left)})null_coalesce((void*)");
                                 TranslateExpression(binaryExpression.Left);
                                 C($", (void*)");
                                 TranslateExpression(binaryExpression.Right);
@@ -306,7 +458,7 @@ public static partial class Transpiler
                         throw new Exception($"Invalid postfix operator {postfixExpression.Op} on line {postfixExpression.Line}");
                     if (paren)
                         C("(");
-                    C($"({TranslateType(GetType(postfixExpression.Left))})runtime_unwrap((void*)");
+                    C($"({TranslateType(GetType(postfixExpression.Left))})unwrap((void*)");
                     TranslateExpression(postfixExpression.Left);
                     C($", {postfixExpression.Line})");
                     if (paren)
@@ -317,7 +469,7 @@ public static partial class Transpiler
                 {
                     if (paren)
                         C("(");
-                    C($"({TranslateType(CurrentType)})runtime_new(state, \"{Namespace}\", \"{Name}\")");
+                    C($"({TranslateType(CurrentType)})runtime_new_def(state, get_{Namespace}_{Name}())");
                     if (paren)
                         C(")");
                     break;
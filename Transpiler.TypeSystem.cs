@@ -117,6 +117,89 @@ public static partial class Transpiler
         AppendFrom(@class);
         return fields;
     }
+    // Vtable of a class: its base's slots in order, with overrides swapped in,
+    // followed by the virtual methods it declares. Each slot remembers the
+    // method that declared it, which is what call sites resolve to.
+    static List<(Method Root, Method Impl)> GetVTable(Class @class)
+    {
+        if (State.VTables.TryGetValue(ClassKey(@class), out var cached))
+            return cached;
+        Class? baseClass = GetBaseClass(@class);
+        List<(Method Root, Method Impl)> slots = baseClass != null ? [.. GetVTable(baseClass)] : new();
+        foreach (var method in @class.Methods)
+        {
+            int slot = slots.FindIndex(s => s.Root.Name == method.Name);
+            if (method.Override)
+            {
+                if (slot == -1)
+                    throw new Exception($"No virtual method {method.Name} to override on line {method.Line}");
+                if (!SameSignature(slots[slot].Root, method))
+                    throw new Exception($"Override {method.Name} does not match the virtual method it overrides on line {method.Line}");
+                slots[slot] = (slots[slot].Root, method);
+            }
+            else if (slot != -1)
+                throw new Exception($"Method {method.Name} hides a virtual method, mark it override on line {method.Line}");
+            else if (method.Virtual)
+                slots.Add((method, method));
+        }
+        State.VTables[ClassKey(@class)] = slots;
+        return slots;
+    }
+    static bool SameType(Type? a, Type? b) => a == null || b == null ? a == b : TypeMatches(a, b) && TypeMatches(b, a);
+    // Everything but self, which is typed as the declaring class.
+    static bool SameSignature(Method method, Method other)
+    {
+        if (method.Arguments.Count != other.Arguments.Count || !SameType(method.ReturnType, other.ReturnType))
+            return false;
+        for (int i = 1; i < method.Arguments.Count; i++)
+            if (!SameType(method.Arguments[i], other.Arguments[i]))
+                return false;
+        return true;
+    }
+    static int GetVirtualSlot(Class @class, Method root)
+    {
+        int slot = GetVTable(@class).FindIndex(s => ReferenceEquals(s.Root, root));
+        return slot != -1 ? slot : throw new Exception($"Method {root.Name} has no vtable slot in {@class.Namespace} {@class.Name}");
+    }
+    // Class hierarchy analysis over every class the package is compiled
+    // against: when the receiver's class and all its subclasses share one
+    // implementation, the virtual call is a plain direct call.
+    static bool TryDevirtualize(Class receiver, Method root, out Method impl)
+    {
+        int slot = GetVirtualSlot(receiver, root);
+        impl = GetVTable(receiver)[slot].Impl;
+        foreach (var @class in classes)
+            if (IsSubclassOf(@class, receiver) && !ReferenceEquals(GetVTable(@class)[slot].Impl, impl))
+                return false;
+        return true;
+    }
+    // Slot of the interface method an interface-typed call resolves to.
+    static int GetInterfaceSlot(InterfaceDef iface, string name, List<Expression> arguments, int line)
+    {
+        List<Type> argumentTypes = arguments.Skip(1).Select(GetType).ToList();
+        int slot = iface.Methods.FindIndex(m => m.Name == name
+            && m.Arguments.Count == argumentTypes.Count
+            && m.Arguments.Zip(argumentTypes).All(p => TypeMatches(p.First, p.Second)));
+        return slot != -1 ? slot : throw new Exception($"Ambiguous/nonexistent interface method call {name} on line {line}");
+    }
+    // Interface table of a class: per interface method, the implementation the
+    // class declares or inherits. Walking up from the class finds overrides
+    // before the virtual methods they replace.
+    static List<Method> GetInterfaceTable(Class @class, InterfaceDef iface)
+    {
+        List<Method> entries = new();
+        foreach (var ifaceMethod in iface.Methods)
+        {
+            Method? impl = null;
+            for (Class? current = @class; current != null && impl == null; current = GetBaseClass(current))
+                impl = current.Methods.FirstOrDefault(m => m.Name == ifaceMethod.Name
+                    && m.Arguments.Count == ifaceMethod.Arguments.Count + 1
+                    && SameType(m.ReturnType, ifaceMethod.ReturnType)
+                    && ifaceMethod.Arguments.Select((a, i) => SameType(a, m.Arguments[i + 1])).All(x => x));
+            entries.Add(impl ?? throw new Exception($"{@class.Namespace} {@class.Name} does not implement {ifaceMethod.Name} of {iface.Namespace} {iface.Name}"));
+        }
+        return entries;
+    }
     static Class GetClass(ClassType classType)
     {
         if (classType.CachedClass != null)
@@ -203,8 +286,11 @@ public static partial class Transpiler
                         type = GetType(callInstanceExpression.Arguments[0]);
                         if (type is not ClassType classType)
                             throw new Exception("Cannot call on a non-class type you moron");
-                        if (TryGetInterface(classType, out _))
-                            throw new Exception($"Cannot call instance methods on interface-typed value on line {callInstanceExpression.Line}");
+                        if (TryGetInterface(classType, out var iface))
+                        {
+                            int slot = GetInterfaceSlot(iface!, callInstanceExpression.Name, callInstanceExpression.Arguments, callInstanceExpression.Line);
+                            return iface!.Methods[slot].ReturnType ?? throw new Exception($"Void returning method used in expression on line {callInstanceExpression.Line}");
+                        }
                         Class? @class = GetClass(classType);
                         if (!GetMethod(ref @class, callInstanceExpression.Name, callInstanceExpression.Arguments.Select(GetType), out method, true))
                             throw new Exception($"Ambiguous/nonexistent method call {callInstanceExpression.Name} on line {callInstanceExpression.Line}");
@@ -255,6 +341,13 @@ public static partial class Transpiler
                 {
                     return new ValueType("cstr", stringExpression.Line);
                 }
+            case InterpolatedStringExpression interpolatedStringExpression:
+                {
+                    foreach (var part in interpolatedStringExpression.Parts)
+                        if (GetStringPartKind(part) == null)
+                            throw new Exception($"Cannot interpolate a {GetType(part).Name} on line {part.Line}");
+                    return new ClassType("STD", "String", interpolatedStringExpression.Line);
+                }
             case BinaryExpression binaryExpression:
                 {
                     switch (binaryExpression.Op)
@@ -10,8 +10,10 @@ public static partial class Transpiler
         public int Indent;
         public DictionaryStack<int, Type> Locals { get; } = new();
         public Dictionary<int, Type> Arguments { get; } = new();
-        public Dictionary<int, (ClassType target, Expression source)> InlineIsBindings { get; } = new();
-        public HashSet<int> VolatileLocals { get; set; } = new();
+        public Dictionary<int, (ClassType target, string temp)> InlineIsBindings { get; } = new();
+        // Labels pending exceptions leave through, innermost try last.
+        public Stack<string> Handlers { get; } = new();
+        public int TryCount;
         public string FullName = "";
         public string FullClassName = "";
         public Type CurrentType = new ValueType("");
@@ -21,8 +23,16 @@ public static partial class Transpiler
         public Class Current = null!;
         public List<string> ImportedNamespaces { get; set; } = new();
         public List<ClassType> UsingTypes { get; set; } = new();
-        public int Blocks;
+        public int FrameSlots;
+        public DictionaryStack<int, int> LocalSlots { get; } = new();
+        public Dictionary<int, int> ArgumentSlots { get; } = new();
         public List<Class> Classes { get; set; } = new();
+        public HashSet<string> PackageClasses { get; set; } = new();
+        public Dictionary<Method, Class> MethodOwners { get; } = new(ReferenceEqualityComparer.Instance);
+        public Dictionary<string, List<(Method Root, Method Impl)>> VTables { get; } = new();
+        public int InlineCaches;
+        // Literal text to its slot in the package's string_literals.
+        public Dictionary<string, int> StringLiterals { get; set; } = new();
         public List<InterfaceDef> Interfaces { get; set; } = new();
     }
 
@@ -33,7 +43,7 @@ public static partial class Transpiler
 
     static readonly string[] valueTypes = new[]
     {
-        "bool", "int", "uint", "long", "ulong", "float", "double", "byte", "char", "short", "ushort", "cstr", "inst"
+        "bool", "int", "uint", "long", "ulong", "float", "double", "byte", "char", "short", "ushort", "cstr", "inst", "parts"
     };
     public static string TranslateType(Type type)
     {
@@ -69,6 +79,8 @@ public static partial class Transpiler
                     return "const char*";
                 case "inst":
                     return "Instance*";
+                case "parts":
+                    return "StringPart*";
                 default:
                     throw new Exception($"Invalid value type {valueType.Name} on line {valueType.Line}");
             }
@@ -90,8 +102,7 @@ public static partial class Transpiler
     static int indent { get => State.Indent; set => State.Indent = value; }
     static DictionaryStack<int, Type> locals => State.Locals;
     static Dictionary<int, Type> arguments => State.Arguments;
-    static Dictionary<int, (ClassType target, Expression source)> inlineIsBindings => State.InlineIsBindings;
-    static HashSet<int> volatileLocals { get => State.VolatileLocals; set => State.VolatileLocals = value; }
+    static Dictionary<int, (ClassType target, string temp)> inlineIsBindings => State.InlineIsBindings;
     static string FullName { get => State.FullName; set => State.FullName = value; }
     static string FullClassName { get => State.FullClassName; set => State.FullClassName = value; }
     static Type CurrentType { get => State.CurrentType; set => State.CurrentType = value; }
@@ -101,8 +112,12 @@ public static partial class Transpiler
     static Class Current { get => State.Current; set => State.Current = value; }
     static List<string> ImportedNamespaces { get => State.ImportedNamespaces; set => State.ImportedNamespaces = value; }
     static List<ClassType> UsingTypes { get => State.UsingTypes; set => State.UsingTypes = value; }
-    static int Blocks { get => State.Blocks; set => State.Blocks = value; }
+    static int FrameSlots { get => State.FrameSlots; set => State.FrameSlots = value; }
+    static string CurrentHandler => State.Handlers.Count > 0 ? State.Handlers.Peek() : "_ret";
+    static DictionaryStack<int, int> localSlots => State.LocalSlots;
+    static Dictionary<int, int> argumentSlots => State.ArgumentSlots;
     static List<Class> classes { get => State.Classes; set => State.Classes = value; }
+    static HashSet<string> packageClasses { get => State.PackageClasses; set => State.PackageClasses = value; }
     static List<InterfaceDef> interfaces { get => State.Interfaces; set => State.Interfaces = value; }
 
     static void H(string text = "") => h.Append(text);
@@ -157,217 +172,131 @@ public static partial class Transpiler
         string args = argTypes.Count == 0 ? "void" : string.Join(", ", argTypes);
         return $"{returnType} (*)({args})";
     }
-    static void CollectLocalIds(Expression expression, HashSet<int> ids)
+    // Whether evaluating an expression may allocate, and so needs a safepoint
+    // after it. Operators, field reads and type tests never do.
+    static bool ContainsCall(Expression expression)
     {
         switch (expression)
         {
-            case LocalExpression localExpression:
-                ids.Add(localExpression.ID);
-                return;
-            case ArgumentExpression:
-            case NumberExpression:
-            case StringExpression:
-            case ClassExpression:
-            case StaticFieldExpression:
+            case CallStaticExpression:
+            case CallExpression:
+            case CallInstanceExpression:
             case NewExpression:
-            case NilExpression:
-                return;
-            case CallStaticExpression callStaticExpression:
-                foreach (var arg in callStaticExpression.Arguments)
-                    CollectLocalIds(arg, ids);
-                return;
-            case CallExpression callExpression:
-                foreach (var arg in callExpression.Arguments)
-                    CollectLocalIds(arg, ids);
-                return;
-            case CallInstanceExpression callInstanceExpression:
-                foreach (var arg in callInstanceExpression.Arguments)
-                    CollectLocalIds(arg, ids);
-                return;
+                return true;
             case InstanceFieldExpression instanceFieldExpression:
-                CollectLocalIds(instanceFieldExpression.Instance, ids);
-                return;
+                return ContainsCall(instanceFieldExpression.Instance);
             case BinaryExpression binaryExpression:
-                CollectLocalIds(binaryExpression.Left, ids);
-                CollectLocalIds(binaryExpression.Right, ids);
-                return;
+                return ContainsCall(binaryExpression.Left) || ContainsCall(binaryExpression.Right);
             case UnaryExpression unaryExpression:
-                CollectLocalIds(unaryExpression.Right, ids);
-                return;
+                return ContainsCall(unaryExpression.Right);
             case PostfixExpression postfixExpression:
-                CollectLocalIds(postfixExpression.Left, ids);
-                return;
+                return ContainsCall(postfixExpression.Left);
+            case InterpolatedStringExpression:
+                return true;
             case IfExpression ifExpression:
-                CollectLocalIds(ifExpression.Condition, ids);
-                CollectLocalIds(ifExpression.True, ids);
-                CollectLocalIds(ifExpression.False, ids);
-                return;
+                return ContainsCall(ifExpression.Condition) || ContainsCall(ifExpression.True) || ContainsCall(ifExpression.False);
             case IsExpression isExpression:
-                CollectLocalIds(isExpression.Source, ids);
-                CollectLocalIds(isExpression.True, ids);
-                CollectLocalIds(isExpression.False, ids);
-                return;
+                return ContainsCall(isExpression.Source) || ContainsCall(isExpression.True) || ContainsCall(isExpression.False);
             case AsExpression asExpression:
-                CollectLocalIds(asExpression.Source, ids);
-                return;
-            default:
-                return;
-        }
-    }
-    static bool ContainsTryStatement(Statement statement)
-    {
-        switch (statement)
-        {
-            case TryStatement:
-                return true;
-            case BlockStatement blockStatement:
-                return blockStatement.Body.Any(ContainsTryStatement);
-            case IfStatement ifStatement:
-                return ContainsTryStatement(ifStatement.True) || (ifStatement.False != null && ContainsTryStatement(ifStatement.False));
-            case WhileStatement whileStatement:
-                return ContainsTryStatement(whileStatement.Body);
-            case IsStatement isStatement:
-                return ContainsTryStatement(isStatement.True) || (isStatement.False != null && ContainsTryStatement(isStatement.False));
+                return ContainsCall(asExpression.Source);
             default:
                 return false;
         }
     }
-    static void CollectStatementLocalReads(Statement statement, HashSet<int> ids)
+    static bool ContainsCall(Statement statement)
     {
         switch (statement)
         {
             case CallStatement callStatement:
-                CollectLocalIds(callStatement.Expression, ids);
-                return;
+                return ContainsCall(callStatement.Expression);
             case ReturnStatement returnStatement:
-                if (returnStatement.Expression != null)
-                    CollectLocalIds(returnStatement.Expression, ids);
-                return;
+                return returnStatement.Expression != null && ContainsCall(returnStatement.Expression);
             case AssignmentStatement assignmentStatement:
-                CollectLocalIds(assignmentStatement.Expression, ids);
-                return;
-            case ThrowStatement throwStatement:
-                CollectLocalIds(throwStatement.Expression, ids);
-                return;
+                return ContainsCall(assignmentStatement.Expression);
+            case ThrowStatement:
+            case TryStatement:
+                return true;
             case LocalAssignmentStatement localAssignmentStatement:
-                CollectLocalIds(localAssignmentStatement.Expression, ids);
-                return;
+                return ContainsCall(localAssignmentStatement.Expression);
             case StaticFieldAssignmentStatement staticFieldAssignmentStatement:
-                CollectLocalIds(staticFieldAssignmentStatement.StaticField, ids);
-                CollectLocalIds(staticFieldAssignmentStatement.Expression, ids);
-                return;
+                return ContainsCall(staticFieldAssignmentStatement.Expression);
             case InstanceFieldAssignmentStatement instanceFieldAssignmentStatement:
-                CollectLocalIds(instanceFieldAssignmentStatement.InstanceField, ids);
-                CollectLocalIds(instanceFieldAssignmentStatement.Expression, ids);
-                return;
+                return ContainsCall(instanceFieldAssignmentStatement.InstanceField) || ContainsCall(instanceFieldAssignmentStatement.Expression);
             case WhileStatement whileStatement:
-                CollectLocalIds(whileStatement.Condition, ids);
-                CollectStatementLocalReads(whileStatement.Body, ids);
-                return;
+                return ContainsCall(whileStatement.Condition) || ContainsCall(whileStatement.Body);
             case IfStatement ifStatement:
-                CollectLocalIds(ifStatement.Condition, ids);
-                CollectStatementLocalReads(ifStatement.True, ids);
-                if (ifStatement.False != null)
-                    CollectStatementLocalReads(ifStatement.False, ids);
-                return;
+                return ContainsCall(ifStatement.Condition) || ContainsCall(ifStatement.True) || (ifStatement.False != null && ContainsCall(ifStatement.False));
             case IsStatement isStatement:
-                CollectLocalIds(isStatement.Source, ids);
-                CollectStatementLocalReads(isStatement.True, ids);
-                if (isStatement.False != null)
-                    CollectStatementLocalReads(isStatement.False, ids);
-                return;
-            case TryStatement tryStatement:
-                CollectStatementLocalReads(tryStatement.Body, ids);
-                foreach (var (_, callStatement) in tryStatement.Catchers)
-                    CollectLocalIds(callStatement.Expression, ids);
-                return;
+                return ContainsCall(isStatement.Source) || ContainsCall(isStatement.True) || (isStatement.False != null && ContainsCall(isStatement.False));
             case BlockStatement blockStatement:
-                foreach (var sub in blockStatement.Body)
-                    CollectStatementLocalReads(sub, ids);
-                return;
+                return blockStatement.Body.Any(ContainsCall);
             default:
-                return;
+                return false;
         }
     }
-    static void CollectLocalReadsAfterTry(Statement statement, HashSet<int> ids, bool afterTry = false)
+    // Frame root slots a statement needs at most: class locals of nested blocks
+    // stack up, sibling blocks reuse the same slots.
+    static int CountRootSlots(Statement statement)
     {
         switch (statement)
         {
             case BlockStatement blockStatement:
-                bool seenTry = afterTry;
-                foreach (var sub in blockStatement.Body)
-                {
-                    if (seenTry)
-                        CollectStatementLocalReads(sub, ids);
-                    CollectLocalReadsAfterTry(sub, ids, seenTry);
-                    if (ContainsTryStatement(sub))
-                        seenTry = true;
-                }
-                return;
+                return blockStatement.Locals.Values.Count(type => type is ClassType)
+                    + blockStatement.Body.Select(CountRootSlots).DefaultIfEmpty(0).Max();
             case IfStatement ifStatement:
-                CollectLocalReadsAfterTry(ifStatement.True, ids, afterTry);
-                if (ifStatement.False != null)
-                    CollectLocalReadsAfterTry(ifStatement.False, ids, afterTry);
-                return;
+                return Math.Max(CountRootSlots(ifStatement.True), ifStatement.False != null ? CountRootSlots(ifStatement.False) : 0);
             case WhileStatement whileStatement:
-                CollectLocalReadsAfterTry(whileStatement.Body, ids, afterTry);
-                return;
+                return CountRootSlots(whileStatement.Body);
             case IsStatement isStatement:
-                CollectLocalReadsAfterTry(isStatement.True, ids, afterTry);
-                if (isStatement.False != null)
-                    CollectLocalReadsAfterTry(isStatement.False, ids, afterTry);
-                return;
-            case TryStatement tryStatement:
-                CollectLocalReadsAfterTry(tryStatement.Body, ids, afterTry);
-                foreach (var (_, callStatement) in tryStatement.Catchers)
-                    CollectLocalIds(callStatement.Expression, ids);
-                return;
+                return Math.Max(1 + CountRootSlots(isStatement.True), isStatement.False != null ? CountRootSlots(isStatement.False) : 0);
             default:
-                return;
+                return 0;
         }
     }
-    static void EmitLocalDeclaration(Type type, int id, bool isVolatile)
+    // Frame root slot of a class local in scope; value locals shadowing a
+    // class local of the same id have none.
+    static bool TryGetLocalSlot(int id, out int slot)
+    {
+        slot = 0;
+        return locals.TryGet(id, out var type) && type is ClassType && localSlots.TryGet(id, out slot);
+    }
+    static void EmitLocalDeclaration(Type type, int id)
     {
-        string cType = TranslateType(type);
-        if (!isVolatile)
-        {
-            CL($"{(type is ClassType ? "class" : "value")}_local({cType}, {id});");
-            return;
-        }
         if (type is ClassType)
         {
-            CL($"{cType} volatile l_{id} = NULL;");
-            CL($"runtime_reference_local(state, (Instance **)&l_{id}, l_r_{id});");
-            CL($"(void)l_{id};");
-        }
-        else
-        {
-            CL($"{cType} volatile l_{id} = 0;");
-            CL($"(void)l_{id};");
+            localSlots.Set(id, FrameSlots);
+            CL($"class_local({FrameSlots++});");
+            return;
         }
+        CL($"value_local({TranslateType(type)}, {id});");
     }
 
     public static (string Header, string Source) TranspileModule(
         List<Class> transpileClasses,
         List<InterfaceDef> allInterfaces,
         List<Class> allClasses,
+        List<Class> compiledClasses,
         List<string> importedNamespaces,
         List<ClassType> usingTypes,
+        Dictionary<string, int> stringLiterals,
         string AllHeaderFileName)
     {
         TranspileState? previousState = currentState;
         currentState = new TranspileState();
         try
         {
+            State.StringLiterals = stringLiterals;
             ImportedNamespaces = importedNamespaces;
             UsingTypes = usingTypes;
             classes = allClasses;
+            packageClasses = compiledClasses.Select(ClassKey).ToHashSet();
             interfaces = allInterfaces;
             h.Clear();
             c.Clear();
             m2.Clear();
 
             CL($"#include \"{AllHeaderFileName}\"");
+            int inlineCachesAt = c.Length;
             foreach (var cls in transpileClasses)
             {
                 BothL();
@@ -379,29 +308,6 @@ public static partial class Transpiler
                 FullClassName = $"{Namespace} {Name}";
                 CurrentType = new ClassType(Namespace, Name);
 
-            Both(BuildSignatureNoArgs($"{FullName}*", $"new_{FullName}"));
-            CL();
-            HL(";");
-            CL("{");
-            CL($"    {FullName}* instance = ({FullName}*)malloc(sizeof({FullName}));");
-            int fieldIndex = 0;
-            foreach (var f in GetAllInstanceFields(cls))
-            {
-                if (f.Type is ValueType)
-                    CL($"    instance->f_{fieldIndex++} = 0;");
-                else
-                    CL($"    instance->f_{fieldIndex++} = NULL;");
-            }
-            CL("    return instance;");
-            CL("}");
-            CL();
-            Both(BuildRealSignature($"void", $"free_{FullName}", $"{FullName}* instance"));
-            HL(";");
-            CL();
-            CL("{");
-            CL("    free(instance);");
-            CL("}");
-
             CL();
             HL($"extern static_{FullName} static_{FullName}_data;");
             CL($"static_{FullName} static_{FullName}_data;");
@@ -414,14 +320,18 @@ public static partial class Transpiler
                 ML2($"Method {FullName}_methods[] = {{");
                 foreach (var method in cls.Methods)
                 {
+                    // Other packages devirtualize against the overrides they saw
+                    // when they were compiled, so overrides stay in the package
+                    // that declares the virtual method.
+                    if (method.Override && !packageClasses.Contains(ClassKey(GetMethodOwner(GetVTable(cls).First(s => ReferenceEquals(s.Impl, method)).Root))))
+                        throw new Exception($"Cannot override {method.Name} declared in another package on line {method.Line}");
                     ReturnType = method.ReturnType;
-                    volatileLocals = new HashSet<int>();
-                    CollectLocalReadsAfterTry(method.Body, volatileLocals);
                     CL();
                     string Return = method.ReturnType != null ? TranslateType(method.ReturnType) : "void";
                     string Name = $"{FullName}_{method.Name}";
                     ML2($"    {{ \"{method.Name}\", (void*){Name} }},");
                     string Signature = BuildSignature(Return, Name, method.Arguments);
+                    HL($"{Signature};");
                     arguments.Clear();
                     int i = 0;
                     foreach (var arg in method.Arguments)
@@ -437,56 +347,77 @@ public static partial class Transpiler
                         {
                             CL($"if (!p_{i})");
                             CL($"{{");
-                            Class @class = GetClass(classType);
-                            CL($"   printf(\"{@class.Namespace} {@class.Name} argument to {method.Name} is nil\\n\");");
+                            string argTypeName = TryGetInterface(classType, out var argInterface)
+                                ? $"{argInterface!.Namespace} {argInterface.Name}"
+                                : $"{GetClass(classType).Namespace} {GetClass(classType).Name}";
+                            CL($"   printf(\"{argTypeName} argument to {method.Name} is nil\\n\");");
                             CL($"   abort();");
                             CL($"}}");
                         }
                         i++;
                     }
-                    if (method.ReturnType != null)
-                        CL($"{(method.ReturnType is ClassType ? "class" : "value")}_ret({Return});");
-                    CL("method_start;");
+                    bool classReturn = method.ReturnType is ClassType;
+                    bool isBox = method.Name == "Box";
+                    bool isUnbox = method.Name == "Unbox";
+                    argumentSlots.Clear();
+                    FrameSlots = classReturn ? 1 : 0;
+                    for (int argIndex = 0; argIndex < method.Arguments.Count; argIndex++)
+                        if (method.Arguments[argIndex] is ClassType)
+                            argumentSlots[argIndex] = FrameSlots++;
+                    int rootCount = FrameSlots + (isBox || isUnbox ? 0 : CountRootSlots(method.Body));
+                    if (method.ReturnType != null && !classReturn)
+                        CL($"value_ret({Return});");
+                    if (rootCount > 0)
+                        CL($"frame_roots({rootCount});");
                     for (int argIndex = 0; argIndex < method.Arguments.Count; argIndex++)
                     {
-                        var arg = method.Arguments[argIndex];
-                        if (arg is ClassType)
-                            CL($"class_arg({argIndex});");
+                        if (argumentSlots.TryGetValue(argIndex, out int slot))
+                            CL($"class_arg({argIndex}, {slot});");
                         else
                             CL($"use(p_{argIndex});");
                     }
-                    bool isBox = method.Name == "Box";
-                    bool isUnbox = method.Name == "Unbox";
                     if (isBox)
                     {
-                        CL($"l_retval = (STD_Any*)runtime_new(state, \"STD\", \"Any\");");
-                        CL($"((STD_Any*)l_retval)->f_0 = (Instance*)p_0;");
+                        CL($"set_frame_root(0, runtime_new_def(state, get_STD_Any()));");
+                        CL($"frame_root(STD_Any*, 0)->f_0 = frame_root(Instance*, {argumentSlots[0]});");
                         CL("do_ret_void;");
                     }
                     else if (isUnbox)
                     {
                         CL("if (!p_0)");
                         CL("{");
-                        CL("    do_ret_value(NULL);");
+                        CL("    do_ret_class(NULL);");
                         CL("}");
                         CL("STD_Any *l_any = (STD_Any*)p_0;");
-                        CL("if (!l_any->f_0)");
-                        CL("    l_retval = NULL;");
-                        CL($"else if (((Instance*)l_any->f_0)->definition == get_{FullName}())");
-                        CL($"    l_retval = ({FullName}*)l_any->f_0;");
-                        CL("else");
-                        CL("    l_retval = NULL;");
-                        CL("do_ret_void;");
+                        CL($"if (l_any->f_0 && ((Instance*)l_any->f_0)->definition == get_{FullName}())");
+                        CL("    do_ret_class(l_any->f_0);");
+                        CL("do_ret_class(NULL);");
                     }
                     else
                     {
                         TranslateStatement(method.Body);
                     }
-                    CL($"method_end;");
-                    if (method.ReturnType is ClassType)
-                        CL("method_end_class_ret;");
+                    // Methods that may allocate end in a safepoint; a class
+                    // return value stays rooted through it.
+                    bool poll = isBox || (!isUnbox && ContainsCall(method.Body));
+                    CL("method_end;");
+                    if (classReturn && poll)
+                    {
+                        CL("frame_keep_ret;");
+                        CL("gc;");
+                        CL("frame_pop;");
+                    }
+                    else
+                    {
+                        if (rootCount > 0)
+                            CL("frame_pop;");
+                        if (poll)
+                            CL("gc;");
+                    }
                     indent--;
-                    if (method.ReturnType != null)
+                    if (classReturn)
+                        CL($"ret_class({Return});");
+                    else if (method.ReturnType != null)
                         CL("ret_value;");
                     else
                         CL("ret_void;");
@@ -496,6 +427,9 @@ public static partial class Transpiler
                 ML2("};");
             }
             }
+            // One monomorphic cache per interface call site.
+            if (State.InlineCaches > 0)
+                c.Insert(inlineCachesAt, $"static InlineCache inline_caches[{State.InlineCaches}];\n");
 
             return (h.ToString(), c.ToString() + m2.ToString());
         }
@@ -504,6 +438,65 @@ public static partial class Transpiler
             currentState = previousState;
         }
     }
+    // Dispatch helpers for the virtual methods of every class the package sees.
+    // Call sites that class hierarchy analysis cannot pin to one implementation
+    // go through these: one vtable load and an indirect call.
+    public static string TranspileVirtualCalls(List<Class> allClasses, List<InterfaceDef> allInterfaces)
+    {
+        TranspileState? previousState = currentState;
+        currentState = new TranspileState();
+        try
+        {
+            classes = allClasses;
+            interfaces = allInterfaces;
+            var sb = new StringBuilder();
+            foreach (var cls in allClasses)
+            {
+                var vtable = GetVTable(cls);
+                for (int slot = 0; slot < vtable.Count; slot++)
+                {
+                    Method root = vtable[slot].Root;
+                    if (!cls.Methods.Any(m => ReferenceEquals(m, root)))
+                        continue;
+                    string returnType = root.ReturnType != null ? TranslateType(root.ReturnType) : "void";
+                    string args = string.Join(", ", Enumerable.Range(0, root.Arguments.Count).Select(i => $"p_{i}"));
+                    sb.AppendLine();
+                    sb.AppendLine($"static inline {BuildSignature(returnType, $"vcall_{cls.Namespace}_{cls.Name}_{root.Name}", root.Arguments)}");
+                    sb.AppendLine("{");
+                    sb.AppendLine($"    {(root.ReturnType != null ? "return " : "")}(({BuildFunctionPointerType(root)})((Instance *)p_0)->definition->vtable[{slot}])({args});");
+                    sb.AppendLine("}");
+                }
+            }
+            // Interface calls check the call site's cache against the receiver's
+            // class and only search the class's interface tables on a miss.
+            foreach (var iface in allInterfaces)
+            {
+                string ifaceName = $"{iface.Namespace}_{iface.Name}";
+                sb.AppendLine();
+                sb.AppendLine($"extern Interface itf_{ifaceName};");
+                for (int slot = 0; slot < iface.Methods.Count; slot++)
+                {
+                    InterfaceMethod method = iface.Methods[slot];
+                    string returnType = method.ReturnType != null ? TranslateType(method.ReturnType) : "void";
+                    List<string> argTypes = ["Instance*", .. method.Arguments.Select(TranslateType)];
+                    string parameters = string.Join(", ", argTypes.Select((t, i) => $"{t} p_{i}"));
+                    string args = string.Join(", ", argTypes.Select((_, i) => $"p_{i}"));
+                    sb.AppendLine();
+                    sb.AppendLine($"static inline {returnType} icall_{ifaceName}_{method.Name}(InlineCache *cache, {parameters})");
+                    sb.AppendLine("{");
+                    sb.AppendLine("    if (p_0->definition != cache->definition)");
+                    sb.AppendLine($"        inline_cache_miss(cache, p_0->definition, &itf_{ifaceName}, {slot});");
+                    sb.AppendLine($"    {(method.ReturnType != null ? "return " : "")}(({returnType} (*)({string.Join(", ", argTypes)}))cache->entry)({args});");
+                    sb.AppendLine("}");
+                }
+            }
+            return sb.ToString();
+        }
+        finally
+        {
+            currentState = previousState;
+        }
+    }
     public static string TranspileTypes(
         List<Class> allClasses,
         List<InterfaceDef> allInterfaces,
@@ -549,6 +542,7 @@ public static partial class Transpiler
             sb.AppendLine($"typedef struct {fullName} {{");
             sb.AppendLine("    Definition *definition;");
             sb.AppendLine("    bool seen;");
+            sb.AppendLine("    uint8_t gc_flags;");
             int i = 0;
             foreach (var f in GetAllInstanceFields(cls))
                 sb.AppendLine($"    {TranslateType(f.Type)} f_{i++}; // {f.Name}");
@@ -573,8 +567,14 @@ public static partial class Transpiler
         }
     }
 
-    public static string TranspileDefinitions(List<Class> compiledClasses, List<Class> allClasses, string AllHeaderFileName)
+    public static string TranspileDefinitions(List<Class> compiledClasses, List<Class> allClasses, List<InterfaceDef> allInterfaces, Dictionary<string, int> stringLiterals, string AllHeaderFileName)
     {
+        TranspileState? previousState = currentState;
+        currentState = new TranspileState();
+        try
+        {
+        classes = allClasses;
+        interfaces = allInterfaces;
         var sb = new StringBuilder();
         sb.AppendLine("#define FUNCTION_VAR");
         sb.AppendLine($"#include \"{AllHeaderFileName}\"");
@@ -585,10 +585,6 @@ public static partial class Transpiler
             string fullName = $"{cls.Namespace}_{cls.Name}";
             sb.AppendLine();
             sb.AppendLine($"Definition *def_{fullName} = NULL;");
-            sb.AppendLine($"Definition *get_{fullName}(void)");
-            sb.AppendLine("{");
-            sb.AppendLine($"    return ensure_definition(&def_{fullName}, \"{cls.Namespace}\", \"{cls.Name}\");");
-            sb.AppendLine("}");
         }
         foreach (var cls in allClasses)
         {
@@ -611,7 +607,7 @@ public static partial class Transpiler
                 foreach (var f in GetAllInstanceFields(cls))
                 {
                     if (f.Type is ClassType)
-                        sb.AppendLine($"    if (obj->f_{i}) runtime_show_instance(state, (Instance*)obj->f_{i});");
+                        sb.AppendLine($"    if (obj->f_{i}) runtime_show_instance(state, (Instance**)&obj->f_{i});");
                     i++;
                 }
                 sb.AppendLine("}");
@@ -626,13 +622,42 @@ public static partial class Transpiler
                 foreach (var f in cls.StaticFields)
                 {
                     if (f.Type is ClassType)
-                        sb.AppendLine($"    if (s->f_{i}) runtime_show_instance(state, (Instance*)s->f_{i});");
+                        sb.AppendLine($"    if (s->f_{i}) runtime_show_instance(state, (Instance**)&s->f_{i});");
                     i++;
                 }
                 sb.AppendLine("}");
             }
         }
         sb.AppendLine($"");
+        foreach (var cls in compiledClasses)
+        {
+            int slots = GetVTable(cls).Count;
+            if (slots > 0)
+                sb.AppendLine($"static void *vtable_{cls.Namespace}_{cls.Name}[{slots}];");
+        }
+        foreach (var iface in allInterfaces)
+            sb.AppendLine($"Interface itf_{iface.Namespace}_{iface.Name} = {{ \"{iface.Namespace} {iface.Name}\", 0 }};");
+        var implemented = compiledClasses.ToDictionary(ClassKey, cls => allInterfaces.Where(i => ClassImplementsInterface(cls, i)).ToList());
+        foreach (var cls in compiledClasses)
+        {
+            string fullName = $"{cls.Namespace}_{cls.Name}";
+            if (implemented[ClassKey(cls)].Count == 0)
+                continue;
+            foreach (var iface in implemented[ClassKey(cls)].Where(i => i.Methods.Count > 0))
+                sb.AppendLine($"static void *itable_{fullName}_{iface.Namespace}_{iface.Name}[{iface.Methods.Count}];");
+            sb.AppendLine($"static InterfaceTable itables_{fullName}[] = {{ {string.Join(", ", implemented[ClassKey(cls)].Select(i =>
+                $"{{ &itf_{i.Namespace}_{i.Name}, {(i.Methods.Count > 0 ? $"itable_{fullName}_{i.Namespace}_{i.Name}" : "NULL")} }}"))} }};");
+        }
+        // String literals live here, already built, for the whole run. The GC
+        // neither traces nor sweeps them; bindImports only fills in their class.
+        if (stringLiterals.Count > 0)
+        {
+            sb.AppendLine();
+            sb.AppendLine($"StringLiteral string_literals[{stringLiterals.Count}] = {{");
+            foreach (var literal in stringLiterals.OrderBy(l => l.Value))
+                sb.AppendLine($"    {{ NULL, false, GC_OLD | GC_IMMORTAL, 0, 0x{StringHash(literal.Key):X8}u, {literal.Key.Length}, {EscapeCString(literal.Key)} }},");
+            sb.AppendLine("};");
+        }
         sb.AppendLine($"");
         sb.AppendLine("static Definition definitions[] = {");
         foreach (var cls in compiledClasses)
@@ -642,8 +667,7 @@ public static partial class Transpiler
             sb.AppendLine($"        .namespace_ = \"{cls.Namespace}\",");
             sb.AppendLine($"        .name = \"{cls.Name}\",");
             sb.AppendLine($"        .instance_size = sizeof({fullName}),");
-            sb.AppendLine($"        .new = (InitFunc)new_{fullName},");
-            sb.AppendLine($"        .free = (FreeFunc)free_{fullName},");
+            sb.AppendLine("        .free = NULL,");
             sb.AppendLine(GetAllInstanceFields(cls).Any(f => f.Type is ClassType)
                 ? $"        .show_refs = show_refs_{fullName},"
                 : "        .show_refs = NULL,");
@@ -651,6 +675,13 @@ public static partial class Transpiler
             sb.AppendLine(cls.StaticFields.Any(f => f.Type is ClassType)
                 ? $"        .show_static_refs = show_static_refs_{fullName},"
                 : "        .show_static_refs = NULL,");
+            if (GetVTable(cls).Count > 0)
+                sb.AppendLine($"        .vtable = vtable_{fullName},");
+            if (implemented[ClassKey(cls)].Count > 0)
+            {
+                sb.AppendLine($"        .itables = itables_{fullName},");
+                sb.AppendLine($"        .itable_count = {implemented[ClassKey(cls)].Count},");
+            }
             if (cls.Methods.Count > 0)
             {
                 sb.AppendLine($"        .methods = {fullName}_methods,");
@@ -666,26 +697,116 @@ public static partial class Transpiler
         sb.AppendLine("};");
         sb.AppendLine($"");
         sb.AppendLine($"");
+        var compiledKeys = compiledClasses.Select(ClassKey).ToHashSet();
+        var importedClasses = allClasses.Where(c => !compiledKeys.Contains(ClassKey(c))).ToList();
+        foreach (var cls in importedClasses.Where(c => c.Methods.Count > 0))
+        {
+            string fullName = $"{cls.Namespace}_{cls.Name}";
+            sb.AppendLine($"void *imp_{fullName}[{cls.Methods.Count}];");
+            sb.AppendLine($"static const char *const imp_{fullName}_names[] = {{ {string.Join(", ", cls.Methods.Select(m => $"\"{m.Name}\""))} }};");
+        }
+        sb.AppendLine($"");
+        sb.AppendLine("static bool bind_methods(Definition *def, void **imports, const char *const *names, int count)");
+        sb.AppendLine("{");
+        sb.AppendLine("    if (def->method_count < count)");
+        sb.AppendLine("        return false;");
+        sb.AppendLine("    for (int i = 0; i < count; i++)");
+        sb.AppendLine("    {");
+        sb.AppendLine("        if (strcmp(def->methods[i].name, names[i]) != 0)");
+        sb.AppendLine("            return false;");
+        sb.AppendLine("        imports[i] = def->methods[i].entry;");
+        sb.AppendLine("    }");
+        sb.AppendLine("    return true;");
+        sb.AppendLine("}");
+        sb.AppendLine($"");
+        sb.AppendLine("// Called by the runtime once every package this one imports is loaded;");
+        sb.AppendLine("// returns the first definition it cannot bind.");
+        sb.AppendLine("EXPORT const char *bindImports(void) {");
+        foreach (var cls in allClasses)
+        {
+            string fullName = $"{cls.Namespace}_{cls.Name}";
+            sb.AppendLine($"    if (!(def_{fullName} = runtime_find_definition(state, \"{cls.Namespace}\", \"{cls.Name}\")))");
+            sb.AppendLine($"        return \"{cls.Namespace} {cls.Name}\";");
+        }
+        foreach (var cls in compiledClasses)
+        {
+            Class? baseClass = GetBaseClass(cls);
+            if (baseClass != null)
+                sb.AppendLine($"    def_{cls.Namespace}_{cls.Name}->base = def_{baseClass.Namespace}_{baseClass.Name};");
+        }
+        foreach (var cls in importedClasses.Where(c => c.Methods.Count > 0))
+        {
+            string fullName = $"{cls.Namespace}_{cls.Name}";
+            sb.AppendLine($"    if (!bind_methods(def_{fullName}, imp_{fullName}, imp_{fullName}_names, {cls.Methods.Count}))");
+            sb.AppendLine($"        return \"{cls.Namespace} {cls.Name} methods\";");
+        }
+        if (stringLiterals.Count > 0)
+        {
+            sb.AppendLine($"    for (int i = 0; i < {stringLiterals.Count}; i++)");
+            sb.AppendLine("        string_literals[i].definition = def_STD_String;");
+        }
+        // Vtable and interface table slots may point at methods of the
+        // packages bound above.
+        foreach (var cls in compiledClasses)
+        {
+            var vtable = GetVTable(cls);
+            for (int slot = 0; slot < vtable.Count; slot++)
+            {
+                Method impl = vtable[slot].Impl;
+                Class owner = GetMethodOwner(impl);
+                string entry = compiledKeys.Contains(ClassKey(owner))
+                    ? $"(void *){owner.Namespace}_{owner.Name}_{impl.Name}"
+                    : $"imp_{owner.Namespace}_{owner.Name}[{impl.i}]";
+                sb.AppendLine($"    vtable_{cls.Namespace}_{cls.Name}[{slot}] = {entry};");
+            }
+            foreach (var iface in implemented[ClassKey(cls)])
+            {
+                var itable = GetInterfaceTable(cls, iface);
+                for (int slot = 0; slot < itable.Count; slot++)
+                {
+                    Class owner = GetMethodOwner(itable[slot]);
+                    string entry = compiledKeys.Contains(ClassKey(owner))
+                        ? $"(void *){owner.Namespace}_{owner.Name}_{itable[slot].Name}"
+                        : $"imp_{owner.Namespace}_{owner.Name}[{itable[slot].i}]";
+                    sb.AppendLine($"    itable_{cls.Namespace}_{cls.Name}_{iface.Namespace}_{iface.Name}[{slot}] = {entry};");
+                }
+            }
+        }
+        sb.AppendLine("    return NULL;");
+        sb.AppendLine("}");
+        sb.AppendLine($"");
+        sb.AppendLine($"");
         sb.AppendLine("EXPORT void getDefinitions(APITable *table) {");
         sb.AppendLine($"    table->count = {compiledClasses.Count};");
         sb.AppendLine("    table->defs = definitions;");
         sb.AppendLine("    state = table->state;");
+        foreach (var iface in allInterfaces)
+            sb.AppendLine($"    itf_{iface.Namespace}_{iface.Name}.id = state->interface_count++;");
         sb.AppendLine("    runtime_init = table->runtime_init;");
         sb.AppendLine("    runtime_load_package = table->runtime_load_package;");
         sb.AppendLine("    runtime_new = table->runtime_new;");
         sb.AppendLine("    runtime_free = table->runtime_free;");
-        sb.AppendLine("    runtime_new_reference_local = table->runtime_new_reference_local;");
         sb.AppendLine("    runtime_gc = table->runtime_gc;");
         sb.AppendLine("    runtime_gc_force = table->runtime_gc_force;");
         sb.AppendLine("    runtime_add_alloc = table->runtime_add_alloc;");
         sb.AppendLine("    runtime_sub_alloc = table->runtime_sub_alloc;");
         sb.AppendLine("    runtime_show_instance = table->runtime_show_instance;");
-        sb.AppendLine("    runtime_null_coalesce = table->runtime_null_coalesce;");
         sb.AppendLine("    runtime_unwrap = table->runtime_unwrap;");
         sb.AppendLine("    runtime_throw = table->runtime_throw;");
         sb.AppendLine("    runtime_exception = table->runtime_exception;");
+        sb.AppendLine("    runtime_remember = table->runtime_remember;");
+        sb.AppendLine("    runtime_remember_statics = table->runtime_remember_statics;");
+        sb.AppendLine("    runtime_new_def = table->runtime_new_def;");
+        sb.AppendLine("    runtime_find_definition = table->runtime_find_definition;");
+        sb.AppendLine("    runtime_shade = table->runtime_shade;");
+        sb.AppendLine("    runtime_gc_threads = table->runtime_gc_threads;");
         sb.AppendLine("}");
         return sb.ToString();
+        }
+        finally
+        {
+            currentState = previousState;
+        }
     }
 
     static bool TypeMatches(Type type, Type other, bool ignoreNullable = false)
@@ -798,7 +919,8 @@ public static partial class Transpiler
                 continue;
             if (!IsSubclassOf(candidateClass, topClass))
                 continue;
-            found.AddRange(candidateClass.Methods.Where(selector).Select(m => (m, candidateClass)));
+            // Overrides share the slot of the virtual method they replace.
+            found.AddRange(candidateClass.Methods.Where(selector).Where(m => !m.Override).Select(m => (m, candidateClass)));
         }
         if (found.Count == 1)
         {
@@ -808,6 +930,16 @@ public static partial class Transpiler
         }
         return false;
     }
+    // Class that declares a method, which for inherited instance methods is
+    // not the receiver's class.
+    static Class GetMethodOwner(Method method)
+    {
+        if (State.MethodOwners.Count == 0)
+            foreach (var @class in classes)
+                foreach (var m in @class.Methods)
+                    State.MethodOwners[m] = @class;
+        return State.MethodOwners.TryGetValue(method, out var owner) ? owner : throw new Exception($"Method {method.Name} has no owning class");
+    }
     static (Class @class, Field field, int fieldId) ResolveUnqualifiedStaticField(string name, int line)
     {
         Class? @class = null;
@@ -835,22 +967,12 @@ public static partial class Transpiler
             throw new Exception($"Field not found on line {line}");
         return (@class, @class.StaticFields[fieldId], fieldId);
     }
-    static List<Class> GetRuntimeMatchClasses(ClassType targetType)
-    {
-        if (TryGetInterface(targetType, out var iface) && iface != null)
-            return classes.Where(c => ClassImplementsInterface(c, iface)).ToList();
-        Class targetClass = GetClass(targetType);
-        return classes.Where(c => ClassMatches(c, targetClass)).ToList();
-    }
     static string BuildRuntimeTypeCheckExpr(string instanceExpr, ClassType targetType)
     {
-        List<Class> matches = GetRuntimeMatchClasses(targetType);
-        if (matches.Count == 0)
-            return "0";
-        var checks = matches
-            .Select(c => $"{instanceExpr}->definition == get_{c.Namespace}_{c.Name}()")
-            .ToArray();
-        return $"({instanceExpr} != NULL && ({string.Join(" || ", checks)}))";
+        if (TryGetInterface(targetType, out var iface))
+            return $"is_interface({instanceExpr}, &itf_{iface!.Namespace}_{iface.Name})";
+        Class targetClass = GetClass(targetType);
+        return $"is_class({instanceExpr}, get_{targetClass.Namespace}_{targetClass.Name}())";
     }
     static int isTempId = 0;
     static void TranslateStatement(Statement statement)
@@ -868,25 +990,29 @@ public static partial class Transpiler
                 }
             case TryStatement tryStatement:
                 {
-                    C("try ");
+                    // Entering a try costs nothing: calls in its body leave
+                    // through its catch dispatch instead of the method's exit.
+                    string handler = $"l_catch_{State.TryCount++}";
+                    State.Handlers.Push(handler);
                     TranslateStatement(tryStatement.Body);
+                    State.Handlers.Pop();
                     indent++;
-                    CL($"catch {{");
+                    CL($"catch_begin({handler})");
+                    // Catchers match in order, each also catching subclasses.
                     foreach (var (type, callStatement) in tryStatement.Catchers)
                     {
-                        Class @class = GetClass(type);
-                        C($"if (strcmp(\"{@class.Namespace}\", exception->definition->namespace_) == 0 && strcmp(\"{type.Name}\", exception->definition->name) == 0) ");
+                        C($"if ({BuildRuntimeTypeCheckExpr("exception", type)}) ");
                         TranslateStatement(callStatement);
                         C("else ");
                     }
                     indent--;
-                    CL($"runtime_throw(state, exception);");
-                    CL("} endcatch");
+                    CL($"do_throw({CurrentHandler}, exception);");
+                    CL("catch_end");
                     break;
                 }
             case ThrowStatement throwStatement:
                 {
-                    C("runtime_throw(state, ");
+                    C($"do_throw({CurrentHandler}, ");
                     TranslateExpression(throwStatement.Expression);
                     CL(");");
                     break;
@@ -905,7 +1031,7 @@ public static partial class Transpiler
                         Type returnType = GetType(returnStatement.Expression);
                         if (!TypeMatches(ReturnType, returnType))
                             throw new Exception($"Return type mismatch on line {returnStatement.Line}");
-                        C("do_ret_value(");
+                        C(ReturnType is ClassType ? "do_ret_class(" : "do_ret_value(");
                         C($"({TranslateType(ReturnType)})");
                         TranslateExpression(returnStatement.Expression);
                         CL(");");
@@ -922,6 +1048,14 @@ public static partial class Transpiler
                     Type type = GetType(assignmentStatement.Expression);
                     if (!TypeMatches(field.Type, type))
                         throw new Exception($"Static field type assignment mismatch on line {assignmentStatement.Line}");
+                    if (field.Type is ClassType)
+                    {
+                        C($"set_static_field({@class.Namespace}_{@class.Name}, {fieldId}, ");
+                        C($"({TranslateType(field.Type)})");
+                        TranslateExpression(assignmentStatement.Expression);
+                        CL(");");
+                        break;
+                    }
                     C($"static_data({@class.Namespace}_{@class.Name})->f_{fieldId}");
                     C($" = ");
                     C($"({TranslateType(field.Type)})");
@@ -936,7 +1070,10 @@ public static partial class Transpiler
                         throw new Exception($"Local not found on line {localAssignmentStatement.Line}");
                     if (!TypeMatches(local!, type))
                         throw new Exception($"Local type assignment mismatch on line {localAssignmentStatement.Line}");
-                    C($"set_local({localAssignmentStatement.ID}, ");
+                    if (TryGetLocalSlot(localAssignmentStatement.ID, out int slot))
+                        C($"set_frame_root({slot}, ");
+                    else
+                        C($"set_local({localAssignmentStatement.ID}, ");
                     C($"({TranslateType(local!)})");
                     TranslateExpression(localAssignmentStatement.Expression);
                     CL(");");
@@ -948,6 +1085,17 @@ public static partial class Transpiler
                     Type field = GetType(staticFieldAssignmentStatement.StaticField);
                     if (!TypeMatches(field, type))
                         throw new Exception($"Static field type assignment mismatch on line {staticFieldAssignmentStatement.Line}");
+                    if (field is ClassType)
+                    {
+                        StaticFieldExpression staticField = staticFieldAssignmentStatement.StaticField;
+                        Class @class = GetClass(staticField.Class);
+                        int fieldId = @class.StaticFields.FindIndex(f => f.Name == staticField.Field);
+                        C($"set_static_field({@class.Namespace}_{@class.Name}, {fieldId}, ");
+                        C($"({TranslateType(field)})");
+                        TranslateExpression(staticFieldAssignmentStatement.Expression);
+                        CL(");");
+                        break;
+                    }
                     TranslateExpression(staticFieldAssignmentStatement.StaticField);
                     C($" = ");
                     C($"({TranslateType(field)})");
@@ -961,6 +1109,18 @@ public static partial class Transpiler
                     Type field = GetType(instanceFieldAssignmentStatement.InstanceField);
                     if (!TypeMatches(field, type))
                         throw new Exception($"Instance field type assignment mismatch on line {instanceFieldAssignmentStatement.Line}");
+                    if (field is ClassType)
+                    {
+                        InstanceFieldExpression instanceField = instanceFieldAssignmentStatement.InstanceField;
+                        Class @class = GetClass((ClassType)GetType(instanceField.Instance));
+                        int fieldId = GetAllInstanceFields(@class).FindIndex(f => f.Name == instanceField.Field);
+                        C($"set_field({@class.Namespace}_{@class.Name}, ");
+                        TranslateExpression(instanceField.Instance);
+                        C($", {fieldId}, ({TranslateType(field)})");
+                        TranslateExpression(instanceFieldAssignmentStatement.Expression);
+                        CL(");");
+                        break;
+                    }
                     TranslateExpression(instanceFieldAssignmentStatement.InstanceField);
                     C($" = ");
                     C($"({TranslateType(field)})");
@@ -973,7 +1133,18 @@ public static partial class Transpiler
                     C("while (");
                     TranslateExpression(whileStatement.Condition, false);
                     C(") ");
+                    if (!ContainsCall(whileStatement.Body) && !ContainsCall(whileStatement.Condition))
+                    {
+                        TranslateStatement(whileStatement.Body);
+                        break;
+                    }
+                    // Back-edge safepoint, for loops that may allocate.
+                    indent++;
+                    CL("{");
                     TranslateStatement(whileStatement.Body);
+                    indent--;
+                    CL("gc;");
+                    CL("}");
                     break;
                 }
             case IfStatement ifStatement:
@@ -1004,11 +1175,14 @@ public static partial class Transpiler
                     CL($"if ({BuildRuntimeTypeCheckExpr(tmpName, isStatement.TargetType)})");
                     CL("{");
                     indent++;
-                    CL($"class_local({targetCType}, {isStatement.BindID});");
-                    CL($"set_local({isStatement.BindID}, ({targetCType}){tmpName});");
+                    int bindSlot = FrameSlots++;
+                    localSlots.Push(new Dictionary<int, int> { { isStatement.BindID, bindSlot } });
+                    CL($"set_frame_root({bindSlot}, {tmpName});");
                     locals.Push(new Dictionary<int, Type> { { isStatement.BindID, isStatement.TargetType } });
                     TranslateStatement(isStatement.True);
                     locals.Pop();
+                    localSlots.Pop();
+                    FrameSlots = bindSlot;
                     indent--;
                     CL("}");
                     if (isStatement.False != null)
@@ -1025,21 +1199,20 @@ public static partial class Transpiler
                     indent++;
                     CL("{");
                     CL();
+                    int blockSlots = FrameSlots;
+                    localSlots.Push();
                     if (blockStatement.Locals.Count > 0)
                     {
-                        CL($"block_enter({Blocks++});");
                         foreach (var local in blockStatement.Locals)
-                            EmitLocalDeclaration(local.Value, local.Key, volatileLocals.Contains(local.Key));
+                            EmitLocalDeclaration(local.Value, local.Key);
                         CL();
                     }
                     locals.Push(blockStatement.Locals);
                     foreach (var subStatement in blockStatement.Body)
                         TranslateStatement(subStatement);
                     locals.Pop();
-                    if (blockStatement.Locals.Count > 0)
-                    {
-                        CL($"block_exit({--Blocks});");
-                    }
+                    localSlots.Pop();
+                    FrameSlots = blockSlots;
                     indent--;
                     CL();
                     CL("}");